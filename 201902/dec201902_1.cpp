@@ -2,74 +2,25 @@
 // Advent of Code 2019, day 2, part one
 //
 
-#include <algorithm>
+#include <cstddef>
 #include <iostream>
-#include <sstream>
-#include <string>
 #include <vector>
 
-std::vector<int> read_program()
-{
-	std::vector<int> program;
-	int code;
-
-	for (char sep = ','; sep == ',' && std::cin >> code; std::cin >> sep) {
-		program.push_back(code);
-	}
-
-	return program;
-}
+#include "../intcode/intcode.h"
 
 int main()
 {
-	std::vector<int> memory = read_program();
-	int pc = 0;
-	bool done = false;
-
-	memory[1] = 12;
-	memory[2] = 2;
+	std::vector<long long> program = read_program(std::cin);
 
-	while (!done) {
-		int opcode = memory[pc];
+	Computer<ConsoleIO> c(program);
 
-		switch (opcode) {
-		case 1:
-		case 2:
-			{
-				int op1, op2, dst;
+	c.poke(1, 12);
+	c.poke(2, 2);
 
-				op1 = memory[pc + 1];
-				op2 = memory[pc + 2];
-				dst = memory[pc + 3];
-
-				int size = std::max(std::max(op1, op2), dst) + 1;
-
-				if (size > memory.size()) {
-					memory.resize(size);
-				}
-
-				if (opcode == 1) {
-					memory[dst] = memory[op1] + memory[op2];
-				}
-				else {
-					memory[dst] = memory[op1] * memory[op2];
-				}
-
-				pc += 4;
-			}
-			break;
-		case 99:
-			done = true;
-			break;
-		default:
-			std::cerr << "opcode error: " << opcode << std::endl;
-			exit(1);
-			break;
-		}
-	}
+	c.run();
 
-	for (const auto &v : memory) {
-		std::cout << v << ',';
+	for (std::size_t i = 0; i < program.size(); ++i) {
+		std::cout << c.peek(i) << ',';
 	}
 
 	return 0;
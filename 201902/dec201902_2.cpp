@@ -2,88 +2,224 @@
 // Advent of Code 2019, day 2, part two
 //
 
+// The program is first run symbolically, with memory holding affine
+// expressions in the verb and noun, which gives a formula for the result
+// that can be solved directly.
+//
+// If that fails, because the program does something that is not affine
+// in the inputs, the verb and noun pairs are split into batches that
+// worker threads take in order, each reusing its own BatchComputer. Once
+// a match is found, batches after it are skipped, and the first match is
+// reported, so the answer is the same as trying the pairs one by one.
+
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
 #include <iostream>
-#include <sstream>
-#include <string>
+#include <optional>
+#include <thread>
+#include <utility>
 #include <vector>
 
-std::vector<int> read_program()
+#include "../intcode/batch.h"
+#include "../intcode/intcode.h"
+
+constexpr std::size_t lanes = 8;
+constexpr int num_pairs = 100 * 100;
+constexpr long long target = 19690720;
+
+// Value c + v * verb + n * noun, or unknown if it came from reading an
+// address that depends on the inputs
+struct Affine {
+	long long c = 0;
+	long long v = 0;
+	long long n = 0;
+	bool known = true;
+
+	bool is_constant() const { return known && v == 0 && n == 0; }
+};
+
+// Run program with the verb at address 1 and noun at address 2 as
+// symbols, and return the expression for address 0. Returns nothing if
+// an opcode or address depends on the inputs, or the result is not
+// affine.
+std::optional<Affine> run_symbolic(const std::vector<long long> &program)
 {
-	std::vector<int> program;
-	int code;
+	std::vector<Affine> memory(program.size());
 
-	for (char sep = ','; sep == ',' && std::cin >> code; std::cin >> sep) {
-		program.push_back(code);
+	for (std::size_t i = 0; i < program.size(); ++i) {
+		memory[i].c = program[i];
 	}
 
-	return program;
-}
+	memory[1] = { 0, 1, 0 };
+	memory[2] = { 0, 0, 1 };
 
-int run_program(std::vector<int> memory, int verb, int noun)
-{
-	int pc = 0;
-	bool done = false;
+	auto address = [&](std::size_t pc) -> std::optional<std::size_t> {
+		if (pc >= memory.size() || !memory[pc].is_constant()
+		 || memory[pc].c < 0 || static_cast<std::size_t>(memory[pc].c) >= memory.size()) {
+			return std::nullopt;
+		}
+
+		return memory[pc].c;
+	};
+
+	for (std::size_t pc = 0; pc < memory.size(); pc += 4) {
+		if (!memory[pc].is_constant()) {
+			return std::nullopt;
+		}
 
-	memory[1] = verb;
-	memory[2] = noun;
+		long long opcode = memory[pc].c;
 
-	while (!done) {
-		int opcode = memory[pc];
+		if (opcode == 99) {
+			if (!memory[0].known) {
+				return std::nullopt;
+			}
+
+			return memory[0];
+		}
+
+		if (opcode != 1 && opcode != 2) {
+			return std::nullopt;
+		}
 
-		switch (opcode) {
-		case 1:
-		case 2:
-			{
-				int op1, op2, dst;
+		auto dst = address(pc + 3);
 
-				op1 = memory[pc + 1];
-				op2 = memory[pc + 2];
-				dst = memory[pc + 3];
+		if (!dst) {
+			return std::nullopt;
+		}
 
-				int size = std::max(std::max(op1, op2), dst) + 1;
+		// An input dependent read address gives an unknown value, which
+		// is fine as long as it is overwritten before it is used
+		auto src1 = address(pc + 1);
+		auto src2 = address(pc + 2);
 
-				if (size > memory.size()) {
-					memory.resize(size);
-				}
+		Affine op1 = src1 ? memory[*src1] : Affine{ 0, 0, 0, false };
+		Affine op2 = src2 ? memory[*src2] : Affine{ 0, 0, 0, false };
 
-				if (opcode == 1) {
-					memory[dst] = memory[op1] + memory[op2];
-				}
-				else {
-					memory[dst] = memory[op1] * memory[op2];
-				}
+		Affine res;
 
-				pc += 4;
-			}
-			break;
-		case 99:
-			done = true;
-			break;
-		default:
-			std::cerr << "opcode error: " << opcode << std::endl;
-			exit(1);
-			break;
+		if (!op1.known || !op2.known) {
+			res.known = false;
+		}
+		else if (opcode == 1) {
+			res = { op1.c + op2.c, op1.v + op2.v, op1.n + op2.n };
 		}
+		else if (op1.is_constant()) {
+			res = { op1.c * op2.c, op1.c * op2.v, op1.c * op2.n };
+		}
+		else if (op2.is_constant()) {
+			res = { op2.c * op1.c, op2.c * op1.v, op2.c * op1.n };
+		}
+		else {
+			return std::nullopt;
+		}
+
+		memory[*dst] = res;
 	}
 
-	return memory[0];
+	return std::nullopt;
 }
 
-int main()
+// Find first verb and noun pair where the result is target
+std::optional<int> solve_symbolic(const std::vector<long long> &program)
 {
-	std::vector<int> memory = read_program();
+	std::optional<Affine> res = run_symbolic(program);
+
+	if (!res) {
+		return std::nullopt;
+	}
 
 	for (int verb = 0; verb < 100; ++verb) {
+		long long rest = target - res->c - res->v * verb;
+
 		for (int noun = 0; noun < 100; ++noun) {
-			int result = run_program(memory, verb, noun);
+			if (res->n * noun == rest) {
+				return verb * 100 + noun;
+			}
+		}
+	}
+
+	return num_pairs;
+}
+
+void search(const std::vector<long long> &program, std::atomic<int> &next, std::atomic<int> &found)
+{
+	BatchComputer<lanes> c(program);
+
+	for (;;) {
+		int first = next.fetch_add(lanes);
 
-			if (result == 19690720) {
-				std::cout << "result at " << verb << ',' << noun << '\n';
-				exit(0);
+		if (first >= num_pairs || first > found) {
+			return;
+		}
+
+		c.reset(program);
+
+		for (std::size_t l = 0; l < lanes; ++l) {
+			c.poke(l, 1, (first + l) / 100);
+			c.poke(l, 2, (first + l) % 100);
+		}
+
+		c.run();
+
+		for (std::size_t l = 0; l < lanes; ++l) {
+			if (c.peek(l, 0) == target) {
+				int pair = first + static_cast<int>(l);
+				int cur = found;
+
+				while (pair < cur && !found.compare_exchange_weak(cur, pair)) {}
+
+				break;
 			}
 		}
 	}
+}
+
+int main()
+{
+	std::vector<long long> program = read_program(std::cin);
+
+	auto start = std::chrono::steady_clock::now();
+
+	std::optional<int> solution = solve_symbolic(program);
+
+	unsigned int num_threads = 0;
+
+	if (!solution) {
+		std::atomic<int> next{0};
+		std::atomic<int> found{num_pairs};
+
+		num_threads = std::max(std::thread::hardware_concurrency(), 1U);
+
+		std::vector<std::thread> workers;
+
+		for (unsigned int i = 1; i < num_threads; ++i) {
+			workers.emplace_back(search, std::cref(program), std::ref(next), std::ref(found));
+		}
+
+		search(program, next, found);
+
+		for (auto &t : workers) {
+			t.join();
+		}
+
+		solution = found;
+	}
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+	if (*solution < num_pairs) {
+		std::cout << "result at " << *solution / 100 << ',' << *solution % 100 << '\n';
+	}
+
+	if (num_threads == 0) {
+		std::cerr << "solved symbolically in " << elapsed.count() << " ms\n";
+	}
+	else {
+		std::cerr << "searched on " << num_threads << " threads in " << elapsed.count() << " ms\n";
+	}
 
 	return 0;
 }
@@ -4,152 +4,44 @@
 
 #include <algorithm>
 #include <array>
-#include <fstream>
+#include <cstdlib>
 #include <iostream>
-#include <sstream>
-#include <string>
+#include <limits>
 #include <vector>
 
-std::vector<int> read_program(const char *filename)
-{
-	std::ifstream infile(filename);
+#include "../intcode/intcode.h"
 
-	std::vector<int> program;
-	int code;
+// IODevice that reads the phase setting on the first input and the input
+// signal after that, and keeps the last output
+struct AmplifierIO {
+	long long phase;
+	long long input;
+	bool phase_done = false;
+	long long output = -1;
 
-	for (char sep = ','; sep == ',' && infile >> code; infile >> sep) {
-		program.push_back(code);
+	bool operator>>(long long &rhs)
+	{
+		rhs = phase_done ? input : phase;
+		phase_done = true;
+		return true;
 	}
 
-	return program;
-}
+	bool operator<<(long long rhs)
+	{
+		output = rhs;
+		return true;
+	}
 
-int run_program(std::vector<int> memory, int phase, int input)
+	AmplifierIO(long long phase, long long input) : phase(phase), input(input) {}
+};
+
+long long run_amplifier(const std::vector<long long> &program, long long phase, long long input)
 {
-	int pc = 0;
-	bool done = false;
-	int output = -1;
-	bool phase_done = false;
+	Computer<AmplifierIO> c(program, phase, input);
 
-	while (!done) {
-		int opcode = memory[pc];
-
-		int pmode1 = (opcode / 100) % 10;
-		int pmode2 = (opcode / 1000) % 10;
-		int pmode3 = (opcode / 10000) % 10;
-
-		opcode = opcode % 100;
-
-		switch (opcode) {
-		case 1:
-		case 2:
-			{
-				int op1 = memory[pc + 1];
-				int op2 = memory[pc + 2];
-				int op3 = memory[pc + 3];
-
-				int size = memory.size();
-				if (!pmode1) { size = std::max(size, op1 + 1); }
-				if (!pmode2) { size = std::max(size, op2 + 1); }
-				if (!pmode3) { size = std::max(size, op3 + 1); }
-
-				if (size > memory.size()) {
-					memory.resize(size);
-				}
-
-				if (opcode == 1) {
-					memory[op3] = (pmode1 ? op1 : memory[op1]) + (pmode2 ? op2 : memory[op2]);
-				}
-				else {
-					memory[op3] = (pmode1 ? op1 : memory[op1]) * (pmode2 ? op2 : memory[op2]);
-				}
-
-				pc += 4;
-			}
-			break;
-		case 3:
-			{
-				int op1 = memory[pc + 1];
-
-				if (phase_done) {
-					memory[op1] = input;
-				}
-				else {
-					memory[op1] = phase;
-					phase_done = true;
-				}
-
-				pc += 2;
-			}
-			break;
-		case 4:
-			{
-				int op1 = memory[pc + 1];
-
-				output = pmode1 ? op1 : memory[op1];
-
-				pc += 2;
-			}
-			break;
-		case 5:
-			{
-				int op1 = memory[pc + 1];
-				int op2 = memory[pc + 2];
-
-				if (pmode1 ? op1 : memory[op1]) {
-					pc = pmode2 ? op2 : memory[op2];
-				}
-				else {
-					pc += 3;
-				}
-			}
-			break;
-		case 6:
-			{
-				int op1 = memory[pc + 1];
-				int op2 = memory[pc + 2];
-
-				if (!(pmode1 ? op1 : memory[op1])) {
-					pc = pmode2 ? op2 : memory[op2];
-				}
-				else {
-					pc += 3;
-				}
-			}
-			break;
-		case 7:
-			{
-				int op1 = memory[pc + 1];
-				int op2 = memory[pc + 2];
-				int op3 = memory[pc + 3];
-
-				memory[op3] = (pmode1 ? op1 : memory[op1]) < (pmode2 ? op2 : memory[op2]);
-
-				pc += 4;
-			}
-			break;
-		case 8:
-			{
-				int op1 = memory[pc + 1];
-				int op2 = memory[pc + 2];
-				int op3 = memory[pc + 3];
-
-				memory[op3] = (pmode1 ? op1 : memory[op1]) == (pmode2 ? op2 : memory[op2]);
-
-				pc += 4;
-			}
-			break;
-		case 99:
-			done = true;
-			break;
-		default:
-			std::cerr << "opcode error: " << opcode << std::endl;
-			exit(1);
-			break;
-		}
-	}
+	c.run();
 
-	return output;
+	return c.io.output;
 }
 
 int main(int argc, char *argv[])
@@ -159,18 +51,18 @@ int main(int argc, char *argv[])
 		exit(1);
 	}
 
-	std::vector<int> memory = read_program(argv[1]);
+	std::vector<long long> program = read_program(argv[1]);
 
-	int max_thrust = std::numeric_limits<int>::min();
+	long long max_thrust = std::numeric_limits<long long>::min();
 
 	std::array<int, 5> phase = { 0, 1, 2, 3, 4 };
 	std::array<int, 5> max_phase = { 0, 1, 2, 3, 4 };
 
 	do {
-		int thrust = 0;
+		long long thrust = 0;
 
 		for (auto p : phase) {
-			thrust = run_program(memory, p, thrust);
+			thrust = run_amplifier(program, p, thrust);
 		}
 
 		if (thrust > max_thrust) {
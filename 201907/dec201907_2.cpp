@@ -2,200 +2,252 @@
 // Advent of Code 2019, day 7, part two
 //
 
+// By default the amplifiers take turns on one thread, each running until
+// it outputs a value.
+//
+// Pass a number of threads after the program file to run each amplifier
+// on its own thread instead, connected by lock-free queues with the last
+// amplifier feeding back into the first, and evaluate that many phase
+// settings at once.
+
 #include <algorithm>
 #include <array>
-#include <fstream>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
 #include <iostream>
-#include <sstream>
+#include <limits>
 #include <string>
-#include <utility>
+#include <thread>
 #include <vector>
 
-std::vector<int> read_program(const char *filename)
-{
-	std::ifstream infile(filename);
+#include "../intcode/intcode.h"
 
-	std::vector<int> program;
-	int code;
+// IODevice that reads the phase setting on the first input and the input
+// signal after that, and pauses after each output
+struct AmplifierIO {
+	long long phase;
+	long long input = 0;
+	bool phase_done = false;
+	long long output = -1;
 
-	for (char sep = ','; sep == ',' && infile >> code; infile >> sep) {
-		program.push_back(code);
+	bool operator>>(long long &rhs)
+	{
+		rhs = phase_done ? input : phase;
+		phase_done = true;
+		return true;
 	}
 
-	return program;
-}
+	bool operator<<(long long rhs)
+	{
+		output = rhs;
+		return false;
+	}
 
-struct Computer {
-	std::vector<int> memory;
-	int pc = 0;
-	bool done = false;
-	bool phase_done = false;
-	int output = -1;
+	explicit AmplifierIO(long long phase) : phase(phase) {}
+};
+
+// Ring buffer for passing values from one producer thread to one consumer
+// thread. The producer only writes tail and the consumer only writes head,
+// so no locks are needed. Size must be a power of two.
+template<typename T, std::size_t Size>
+class SpscQueue {
+public:
+	// Add value, waiting while the queue is full
+	void push(T value)
+	{
+		std::size_t t = tail.load(std::memory_order_relaxed);
+
+		while (t - head.load(std::memory_order_acquire) == Size) {
+			std::this_thread::yield();
+		}
+
+		buffer[t & (Size - 1)] = value;
+
+		tail.store(t + 1, std::memory_order_release);
+	}
+
+	// Remove next value, waiting while the queue is empty
+	T pop()
+	{
+		std::size_t h = head.load(std::memory_order_relaxed);
+
+		while (tail.load(std::memory_order_acquire) == h) {
+			std::this_thread::yield();
+		}
+
+		T value = buffer[h & (Size - 1)];
+
+		head.store(h + 1, std::memory_order_release);
 
-	explicit Computer(std::vector<int> program) : memory(std::move(program)) {}
+		return value;
+	}
+
+private:
+	static_assert((Size & (Size - 1)) == 0, "Size must be a power of two");
+
+	// Keep the indices on separate cache lines so the two threads do not
+	// keep taking the line from each other
+	alignas(64) std::atomic<std::size_t> head{0};
+	alignas(64) std::atomic<std::size_t> tail{0};
+	std::array<T, Size> buffer{};
+};
+
+using Channel = SpscQueue<long long, 64>;
+
+// IODevice that reads input from one channel and writes output to
+// another, keeping the last output
+struct ChannelIO {
+	Channel *in;
+	Channel *out;
+	long long output = -1;
+
+	bool operator>>(long long &rhs)
+	{
+		rhs = in->pop();
+		return true;
+	}
+
+	bool operator<<(long long rhs)
+	{
+		output = rhs;
+		out->push(rhs);
+		return true;
+	}
+
+	ChannelIO(Channel *in, Channel *out) : in(in), out(out) {}
 };
 
-int run_program(Computer &c, int phase, int input)
+// Run a chain of amplifiers, one per phase setting, each on its own thread,
+// with the output of the last one fed back to the first, and return the
+// last output of the last amplifier
+long long run_chain(const std::vector<long long> &program, const std::vector<long long> &phase)
 {
-	while (!c.done) {
-		int opcode = c.memory[c.pc];
-
-		int pmode1 = (opcode / 100) % 10;
-		int pmode2 = (opcode / 1000) % 10;
-		int pmode3 = (opcode / 10000) % 10;
-
-		opcode = opcode % 100;
-
-		switch (opcode) {
-		case 1:
-		case 2:
-			{
-				int op1 = c.memory[c.pc + 1];
-				int op2 = c.memory[c.pc + 2];
-				int op3 = c.memory[c.pc + 3];
-
-				int size = c.memory.size();
-				if (!pmode1) { size = std::max(size, op1 + 1); }
-				if (!pmode2) { size = std::max(size, op2 + 1); }
-				if (!pmode3) { size = std::max(size, op3 + 1); }
-
-				if (size > c.memory.size()) {
-					c.memory.resize(size);
-				}
+	std::size_t n = phase.size();
 
-				if (opcode == 1) {
-					c.memory[op3] = (pmode1 ? op1 : c.memory[op1]) + (pmode2 ? op2 : c.memory[op2]);
-				}
-				else {
-					c.memory[op3] = (pmode1 ? op1 : c.memory[op1]) * (pmode2 ? op2 : c.memory[op2]);
-				}
+	std::vector<Channel> channels(n);
+	std::vector<Computer<ChannelIO>> amps;
 
-				c.pc += 4;
-			}
-			break;
-		case 3:
-			{
-				int op1 = c.memory[c.pc + 1];
+	amps.reserve(n);
 
-				if (c.phase_done) {
-					c.memory[op1] = input;
-				}
-				else {
-					c.memory[op1] = phase;
-					c.phase_done = true;
-				}
+	for (std::size_t i = 0; i < n; ++i) {
+		amps.emplace_back(program, &channels[i], &channels[(i + 1) % n]);
+	}
 
-				c.pc += 2;
-			}
-			break;
-		case 4:
-			{
-				int op1 = c.memory[c.pc + 1];
+	// Channel i is the input of amplifier i
+	for (std::size_t i = 0; i < n; ++i) {
+		channels[i].push(phase[i]);
+	}
 
-				c.output = pmode1 ? op1 : c.memory[op1];
+	channels[0].push(0);
 
-				c.pc += 2;
+	std::vector<std::thread> threads;
 
-				return c.output;
-			}
-			break;
-		case 5:
-			{
-				int op1 = c.memory[c.pc + 1];
-				int op2 = c.memory[c.pc + 2];
-
-				if (pmode1 ? op1 : c.memory[op1]) {
-					c.pc = pmode2 ? op2 : c.memory[op2];
-				}
-				else {
-					c.pc += 3;
-				}
-			}
-			break;
-		case 6:
-			{
-				int op1 = c.memory[c.pc + 1];
-				int op2 = c.memory[c.pc + 2];
-
-				if (!(pmode1 ? op1 : c.memory[op1])) {
-					c.pc = pmode2 ? op2 : c.memory[op2];
-				}
-				else {
-					c.pc += 3;
-				}
-			}
-			break;
-		case 7:
-			{
-				int op1 = c.memory[c.pc + 1];
-				int op2 = c.memory[c.pc + 2];
-				int op3 = c.memory[c.pc + 3];
+	for (std::size_t i = 0; i < n; ++i) {
+		threads.emplace_back([&amp = amps[i]] { amp.run(); });
+	}
 
-				c.memory[op3] = (pmode1 ? op1 : c.memory[op1]) < (pmode2 ? op2 : c.memory[op2]);
+	for (auto &t : threads) {
+		t.join();
+	}
 
-				c.pc += 4;
-			}
-			break;
-		case 8:
-			{
-				int op1 = c.memory[c.pc + 1];
-				int op2 = c.memory[c.pc + 2];
-				int op3 = c.memory[c.pc + 3];
+	return amps[n - 1].io.output;
+}
 
-				c.memory[op3] = (pmode1 ? op1 : c.memory[op1]) == (pmode2 ? op2 : c.memory[op2]);
+// Evaluate all phase settings, running chains on num_threads threads at a
+// time, and return the thrust for each
+std::vector<long long> run_chains(const std::vector<long long> &program,
+                                  const std::vector<std::vector<long long>> &phases,
+                                  unsigned int num_threads)
+{
+	std::vector<long long> thrust(phases.size());
+	std::atomic<std::size_t> next{0};
 
-				c.pc += 4;
-			}
-			break;
-		case 99:
-			c.done = true;
-			break;
-		default:
-			std::cerr << "opcode error: " << opcode << std::endl;
-			exit(1);
-			break;
+	auto work = [&] {
+		for (std::size_t i = next++; i < phases.size(); i = next++) {
+			thrust[i] = run_chain(program, phases[i]);
 		}
+	};
+
+	std::vector<std::thread> workers;
+
+	for (unsigned int i = 1; i < num_threads; ++i) {
+		workers.emplace_back(work);
+	}
+
+	work();
+
+	for (auto &t : workers) {
+		t.join();
 	}
 
-	return c.output;
+	return thrust;
 }
 
 int main(int argc, char *argv[])
 {
-	if (argc != 2) {
+	if (argc != 2 && argc != 3) {
 		std::cerr << "no program file\n";
 		exit(1);
 	}
 
-	std::vector<int> memory = read_program(argv[1]);
+	std::vector<long long> program = read_program(argv[1]);
 
-	int max_thrust = std::numeric_limits<int>::min();
+	long long max_thrust = std::numeric_limits<long long>::min();
 
 	std::array<int, 5> phase = { 5, 6, 7, 8, 9 };
 	std::array<int, 5> max_phase = { 5, 6, 7, 8, 9 };
 
-	do {
-		Computer a(memory);
-		Computer b(memory);
-		Computer c(memory);
-		Computer d(memory);
-		Computer e(memory);
+	if (argc == 3) {
+		unsigned int num_threads = std::max(std::stoi(argv[2]), 1);
 
-		int thrust = 0;
+		std::vector<std::vector<long long>> phases;
 
 		do {
-			thrust = run_program(a, phase[0], thrust);
-			thrust = run_program(b, phase[1], thrust);
-			thrust = run_program(c, phase[2], thrust);
-			thrust = run_program(d, phase[3], thrust);
-			thrust = run_program(e, phase[4], thrust);
-		} while (!e.done);
-
-		if (thrust > max_thrust) {
-			max_thrust = thrust;
-			max_phase = phase;
+			phases.emplace_back(phase.begin(), phase.end());
+		} while (std::next_permutation(phase.begin(), phase.end()));
+
+		auto start = std::chrono::steady_clock::now();
+
+		std::vector<long long> thrust = run_chains(program, phases, num_threads);
+
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+		for (std::size_t i = 0; i < phases.size(); ++i) {
+			if (thrust[i] > max_thrust) {
+				max_thrust = thrust[i];
+				std::copy(phases[i].begin(), phases[i].end(), max_phase.begin());
+			}
 		}
-	} while (std::next_permutation(phase.begin(), phase.end()));
+
+		std::cerr << num_threads << " chains of " << phase.size() << " threads at a time, "
+		          << elapsed.count() << " ms\n";
+	}
+	else {
+		do {
+			std::vector<Computer<AmplifierIO>> amps;
+
+			for (auto p : phase) {
+				amps.emplace_back(program, p);
+			}
+
+			long long thrust = 0;
+
+			do {
+				for (auto &amp : amps) {
+					amp.io.input = thrust;
+					amp.run();
+					thrust = amp.io.output;
+				}
+			} while (!amps.back().halted());
+
+			if (thrust > max_thrust) {
+				max_thrust = thrust;
+				max_phase = phase;
+			}
+		} while (std::next_permutation(phase.begin(), phase.end()));
+	}
 
 	std::cout << "max thruster signal " << max_thrust << " at "
 		<< max_phase[0] << ','
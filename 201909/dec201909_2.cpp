@@ -0,0 +1,104 @@
+//
+// Advent of Code 2019, day 9, part two
+//
+
+// Running BOOST in sensor boost mode takes a few hundred thousand
+// instructions, which makes it a good benchmark for the Intcode computer,
+// so this uses the JIT where it is available, and reports the number of
+// instructions and the time taken on stderr. Pass --repeat N after the
+// program file to run it N times and get the best and mean times.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifndef INTCODE_JIT
+#  define INTCODE_JIT 1
+#endif
+
+#include "../intcode/intcode.h"
+#include "../intcode/reference.h"
+
+struct BoostIO {
+	std::vector<long long> outputs;
+
+	bool operator>>(long long &rhs)
+	{
+		// Sensor boost mode
+		rhs = 2;
+		return true;
+	}
+
+	bool operator<<(long long rhs)
+	{
+		outputs.push_back(rhs);
+		return true;
+	}
+};
+
+int main(int argc, char *argv[])
+{
+	if (argc != 2 && !(argc == 4 && std::string(argv[2]) == "--repeat")) {
+		std::cerr << "usage: dec201909_2 PROGRAM [--repeat N]\n";
+		exit(1);
+	}
+
+	int repeat = argc == 4 ? std::max(std::stoi(argv[3]), 1) : 1;
+
+	auto image = ProgramImage::load(argv[1]);
+
+	std::vector<long long> outputs;
+	std::chrono::duration<double> best{0};
+	std::chrono::duration<double> total{0};
+
+	for (int i = 0; i < repeat; ++i) {
+		auto start = std::chrono::steady_clock::now();
+
+		Computer<BoostIO> c(image);
+
+		c.run();
+
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		if (i == 0 || elapsed < best) {
+			best = elapsed;
+		}
+
+		total += elapsed;
+
+		if (i == 0) {
+			outputs = std::move(c.io.outputs);
+		}
+		else if (c.io.outputs != outputs) {
+			std::cerr << "run " << i << " gave different output\n";
+			exit(1);
+		}
+	}
+
+	for (long long value : outputs) {
+		std::cout << value << '\n';
+	}
+
+	// Count the instructions with the reference interpreter, since the
+	// engines that are fast enough to benchmark do not count them
+	ReferenceComputer<BoostIO> counter(image->to_vector());
+
+	counter.run();
+
+	long long instructions = counter.instructions();
+
+	std::cerr << (INTCODE_JIT ? "jit" : INTCODE_THREADED ? "threaded" : "switch") << ": "
+	          << instructions << " instructions in " << best.count() * 1e3 << " ms, "
+	          << instructions / best.count() / 1e6 << " Minstr/s";
+
+	if (repeat > 1) {
+		std::cerr << ", best of " << repeat << ", mean " << total.count() / repeat * 1e3 << " ms";
+	}
+
+	std::cerr << '\n';
+
+	return 0;
+}
@@ -2,16 +2,23 @@
 // Advent of Code 2019, day 11, part two
 //
 
+// The robot is controlled by a coroutine that gives the program the color
+// under the robot and waits for the color to paint and the way to turn.
+//
+// Requires C++20.
+
 #include <algorithm>
 #include <array>
-#include <fstream>
 #include <iostream>
-#include <sstream>
+#include <optional>
 #include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "../intcode/coroutine.h"
+#include "../intcode/intcode.h"
+
 struct PairHash {
 	template<typename T1, typename T2>
 	std::size_t operator()(const std::pair<T1, T2> &p) const noexcept
@@ -23,189 +30,22 @@ struct PairHash {
 	}
 };
 
-std::vector<long long> read_program(const char *filename)
-{
-	std::ifstream infile(filename);
-
-	std::vector<long long> program;
-	long long code;
-
-	for (char sep = ','; sep == ',' && infile >> code; infile >> sep) {
-		program.push_back(code);
-	}
-
-	return program;
-}
-
-struct Computer {
-	std::vector<long long> memory;
-	long long pc = 0;
-	long long base = 0;
-	bool done = false;
-
-	explicit Computer(std::vector<long long> program) : memory(std::move(program)) {}
-
-	long long get_arg(long long address, int mode) {
-		if (mode == 1) {
-			return address;
-		}
-
-		if (mode == 2) {
-			address = base + address;
-		}
-
-		auto size = std::max(memory.size(), static_cast<size_t>(address) + 1);
-		if (size > memory.size()) {
-			memory.resize(size);
-		}
-
-		return memory[address];
-	}
-
-	void set_arg(long long address, int mode, long long value) {
-		if (mode == 2) {
-			address = base + address;
-		}
-
-		auto size = std::max(memory.size(), static_cast<size_t>(address) + 1);
-		if (size > memory.size()) {
-			memory.resize(size);
-		}
-
-		memory[address] = value;
-	}
-};
-
-int run_program(Computer &c, int input)
-{
-	while (!c.done) {
-		int opcode = static_cast<int>(c.memory[c.pc]);
-
-		int pmode1 = (opcode / 100) % 10;
-		int pmode2 = (opcode / 1000) % 10;
-		int pmode3 = (opcode / 10000) % 10;
-
-		opcode = opcode % 100;
-
-		switch (opcode) {
-		case 1:
-		case 2:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-				long long op2 = c.get_arg(c.memory[c.pc + 2], pmode2);
-				long long dst3 = c.memory[c.pc + 3];
-
-				if (opcode == 1) {
-					c.set_arg(dst3, pmode3, op1 + op2);
-				}
-				else {
-					c.set_arg(dst3, pmode3, op1 * op2);
-				}
-
-				c.pc += 4;
-			}
-			break;
-		case 3:
-			{
-				long long dst1 = c.memory[c.pc + 1];
-
-				c.set_arg(dst1, pmode1, input);
-
-				c.pc += 2;
-			}
-			break;
-		case 4:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-
-				c.pc += 2;
-
-				return static_cast<int>(op1);
-			}
-			break;
-		case 5:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-				long long op2 = c.get_arg(c.memory[c.pc + 2], pmode2);
-
-				if (op1) {
-					c.pc = op2;
-				}
-				else {
-					c.pc += 3;
-				}
-			}
-			break;
-		case 6:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-				long long op2 = c.get_arg(c.memory[c.pc + 2], pmode2);
-
-				if (!op1) {
-					c.pc = op2;
-				}
-				else {
-					c.pc += 3;
-				}
-			}
-			break;
-		case 7:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-				long long op2 = c.get_arg(c.memory[c.pc + 2], pmode2);
-				long long dst3 = c.memory[c.pc + 3];
-
-				c.set_arg(dst3, pmode3, op1 < op2);
-
-				c.pc += 4;
-			}
-			break;
-		case 8:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-				long long op2 = c.get_arg(c.memory[c.pc + 2], pmode2);
-				long long dst3 = c.memory[c.pc + 3];
-
-				c.set_arg(dst3, pmode3, op1 == op2);
-
-				c.pc += 4;
-			}
-			break;
-		case 9:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-
-				c.base += op1;
-
-				c.pc += 2;
-			}
-			break;
-		case 99:
-			c.done = true;
-			break;
-		default:
-			std::cerr << "opcode error: " << opcode << std::endl;
-			exit(1);
-			break;
-		}
-	}
-
-	return -1;
-}
-
 enum class Direction {
 	up, right, down, left
 };
 
+using Grid = std::unordered_map<std::pair<int, int>, int, PairHash>;
+
 struct Robot {
-	Computer c;
+	std::vector<long long> program;
 	Direction direction = Direction::up;
 	int x = 0;
 	int y = 0;
 
-	explicit Robot(std::vector<long long> program) : c(std::move(program)) {}
+	explicit Robot(std::vector<long long> program) : program(std::move(program)) {}
 
 	int paint();
+	IOTask control(Grid &grid);
 	void turn(int right);
 	void move();
 };
@@ -246,26 +86,42 @@ void Robot::move()
 	}
 }
 
-int Robot::paint()
+IOTask Robot::control(Grid &grid)
 {
-	std::unordered_map<std::pair<int, int>, int, PairHash> grid;
-
-	// Start on white
-	grid[{x, y}] = 2;
-
 	for (;;) {
 		int current = grid[{x, y}];
-		int color = run_program(c, current ? current - 1 : 0);
-		if (c.done) {
-			break;
+
+		co_yield current ? current - 1 : 0;
+
+		std::optional<long long> color = co_await next_output;
+		std::optional<long long> right = co_await next_output;
+
+		if (!color || !right) {
+			co_return;
 		}
-		int right = run_program(c, current ? current - 1 : 0);
 
-		grid[{x, y}] = color + 1;
+		grid[{x, y}] = static_cast<int>(*color) + 1;
 
-		turn(right);
+		turn(static_cast<int>(*right));
 		move();
 	}
+}
+
+int Robot::paint()
+{
+	Grid grid;
+
+	// Start on white
+	grid[{x, y}] = 2;
+
+	Computer<CoroutineIO> c(program, control(grid));
+
+	if (c.run()) {
+		std::cerr << "robot and program both waiting\n";
+		exit(1);
+	}
+
+	c.io.finish();
 
 	// Finding min and max coordinates shows the result is 43x6 large
 	for (int y = 0; y < 6; ++y) {
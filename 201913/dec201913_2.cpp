@@ -2,223 +2,83 @@
 // Advent of Code 2019, day 13, part two
 //
 
-// In the output instruction we store the x position of the bat and the ball,
-// and in the input instruction we move the bat towards the ball.
+// The game is played by a coroutine that draws the tiles the program
+// outputs, and when it has drawn them all, moves the bat towards the ball.
+//
+// Requires C++20.
 
 #include <algorithm>
 #include <array>
-#include <fstream>
 #include <iostream>
-#include <sstream>
+#include <optional>
 #include <string>
 #include <utility>
 #include <vector>
 
-std::vector<long long> read_program(const char *filename)
-{
-	std::ifstream infile(filename);
-
-	std::vector<long long> program;
-	long long code;
-
-	for (char sep = ','; sep == ',' && infile >> code; infile >> sep) {
-		program.push_back(code);
-	}
-
-	return program;
-}
-
-struct Computer {
-	std::vector<long long> memory;
-	long long pc = 0;
-	long long base = 0;
-	bool done = false;
-
-	explicit Computer(std::vector<long long> program) : memory(std::move(program)) {}
-
-	long long get_arg(long long address, int mode) {
-		if (mode == 1) {
-			return address;
-		}
+#include "../intcode/coroutine.h"
+#include "../intcode/intcode.h"
 
-		if (mode == 2) {
-			address = base + address;
-		}
+struct Arcade {
+	std::array<std::array<int, 40>, 40> screen;
+	int score = 0;
 
-		auto size = std::max(memory.size(), static_cast<size_t>(address) + 1);
-		if (size > memory.size()) {
-			memory.resize(size);
+	Arcade()
+	{
+		for (auto &row : screen) {
+			row.fill(0);
 		}
-
-		return memory[address];
 	}
 
-	void set_arg(long long address, int mode, long long value) {
-		if (mode == 2) {
-			address = base + address;
-		}
-
-		auto size = std::max(memory.size(), static_cast<size_t>(address) + 1);
-		if (size > memory.size()) {
-			memory.resize(size);
-		}
-
-		memory[address] = value;
-	}
+	IOTask control();
+	int play_game(const std::vector<long long> &program);
 };
 
-int play_game(Computer &c)
+IOTask Arcade::control()
 {
-	static const char tiles[] = " X#=O";
-
-	std::vector<int> output;
-
-	int score = 0;
-
-	std::array<std::array<int, 40>, 40> screen;
-
-	for (auto &row : screen) {
-		row.fill(0);
-	}
-
 	int ball_x = 0;
 	int bat_x = 0;
 
-	while (!c.done) {
-		int opcode = static_cast<int>(c.memory[c.pc]);
-
-		int pmode1 = (opcode / 100) % 10;
-		int pmode2 = (opcode / 1000) % 10;
-		int pmode3 = (opcode / 10000) % 10;
-
-		opcode = opcode % 100;
-
-		switch (opcode) {
-		case 1:
-		case 2:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-				long long op2 = c.get_arg(c.memory[c.pc + 2], pmode2);
-				long long dst3 = c.memory[c.pc + 3];
-
-				if (opcode == 1) {
-					c.set_arg(dst3, pmode3, op1 + op2);
-				}
-				else {
-					c.set_arg(dst3, pmode3, op1 * op2);
-				}
-
-				c.pc += 4;
-			}
-			break;
-		case 3:
-			{
-				long long dst1 = c.memory[c.pc + 1];
-
-				int input = ball_x > bat_x ? 1 : ball_x < bat_x ? -1 : 0;
-
-				c.set_arg(dst1, pmode1, input);
+	for (;;) {
+		while (co_await has_output) {
+			std::optional<long long> x = co_await next_output;
+			std::optional<long long> y = co_await next_output;
+			std::optional<long long> id = co_await next_output;
 
-				c.pc += 2;
+			if (!x || !y || !id) {
+				co_return;
 			}
-			break;
-		case 4:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-
-				output.push_back(static_cast<int>(op1));
-
-				if (output.size() == 3) {
-					int x = output[0];
-					int y = output[1];
-					int id = output[2];
-
-					output.clear();
-
-					if (x == -1 && y == 0) {
-						score = id;
-					}
-					else {
-						screen[y][x] = id;
-						if (id == 3) {
-							bat_x = x;
-						}
-						else if (id == 4) {
-							ball_x = x;
-						}
-					}
-				}
 
-				c.pc += 2;
-			}
-			break;
-		case 5:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-				long long op2 = c.get_arg(c.memory[c.pc + 2], pmode2);
-
-				if (op1) {
-					c.pc = op2;
-				}
-				else {
-					c.pc += 3;
-				}
+			if (*x == -1 && *y == 0) {
+				score = static_cast<int>(*id);
 			}
-			break;
-		case 6:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-				long long op2 = c.get_arg(c.memory[c.pc + 2], pmode2);
-
-				if (!op1) {
-					c.pc = op2;
+			else {
+				screen[*y][*x] = static_cast<int>(*id);
+				if (*id == 3) {
+					bat_x = static_cast<int>(*x);
 				}
-				else {
-					c.pc += 3;
+				else if (*id == 4) {
+					ball_x = static_cast<int>(*x);
 				}
 			}
-			break;
-		case 7:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-				long long op2 = c.get_arg(c.memory[c.pc + 2], pmode2);
-				long long dst3 = c.memory[c.pc + 3];
-
-				c.set_arg(dst3, pmode3, op1 < op2);
-
-				c.pc += 4;
-			}
-			break;
-		case 8:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-				long long op2 = c.get_arg(c.memory[c.pc + 2], pmode2);
-				long long dst3 = c.memory[c.pc + 3];
+		}
 
-				c.set_arg(dst3, pmode3, op1 == op2);
+		co_yield ball_x > bat_x ? 1 : ball_x < bat_x ? -1 : 0;
+	}
+}
 
-				c.pc += 4;
-			}
-			break;
-		case 9:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
+int Arcade::play_game(const std::vector<long long> &program)
+{
+	static const char tiles[] = " X#=O";
 
-				c.base += op1;
+	Computer<CoroutineIO> c(program, control());
 
-				c.pc += 2;
-			}
-			break;
-		case 99:
-			c.done = true;
-			break;
-		default:
-			std::cerr << "opcode error: " << opcode << std::endl;
-			exit(1);
-			break;
-		}
+	if (c.run()) {
+		std::cerr << "arcade and program both waiting\n";
+		exit(1);
 	}
 
+	c.io.finish();
+
 	std::cout << score << '\n';
 
 	for (const auto &row : screen) {
@@ -242,9 +102,9 @@ int main(int argc, char *argv[])
 
 	program[0] = 2;
 
-	Computer c(program);
+	Arcade arcade;
 
-	std::cout << "Final score: " << play_game(c) << '\n';
+	std::cout << "Final score: " << arcade.play_game(program) << '\n';
 
 	return 0;
 }
@@ -4,15 +4,15 @@
 
 #include <algorithm>
 #include <array>
-#include <fstream>
 #include <iostream>
 #include <queue>
-#include <sstream>
 #include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "../intcode/intcode.h"
+
 struct PairHash {
 	template<typename T1, typename T2>
 	std::size_t operator()(const std::pair<T1, T2> &p) const noexcept
@@ -26,224 +26,56 @@ struct PairHash {
 
 using Map = std::unordered_map<std::pair<int, int>, int, PairHash>;
 
-std::vector<long long> read_program(const char *filename)
-{
-	std::ifstream infile(filename);
-
-	std::vector<long long> program;
-	long long code;
-
-	for (char sep = ','; sep == ',' && infile >> code; infile >> sep) {
-		program.push_back(code);
-	}
-
-	return program;
-}
-
-struct Computer {
-	std::vector<long long> memory;
-	long long pc = 0;
-	long long base = 0;
-	bool done = false;
-
-	explicit Computer(std::vector<long long> program) : memory(std::move(program)) {}
-
-	long long get_arg(long long address, int mode) {
-		if (mode == 1) {
-			return address;
-		}
-
-		if (mode == 2) {
-			address = base + address;
-		}
-
-		auto size = std::max(memory.size(), static_cast<size_t>(address) + 1);
-		if (size > memory.size()) {
-			memory.resize(size);
-		}
+struct DroidIO {
+	long long input = 0;
+	long long output = -1;
 
-		return memory[address];
+	bool operator>>(long long &rhs)
+	{
+		rhs = input;
+		return true;
 	}
 
-	void set_arg(long long address, int mode, long long value) {
-		if (mode == 2) {
-			address = base + address;
-		}
-
-		auto size = std::max(memory.size(), static_cast<size_t>(address) + 1);
-		if (size > memory.size()) {
-			memory.resize(size);
-		}
-
-		memory[address] = value;
+	// Pause after each output so the droid can act on the reply
+	bool operator<<(long long rhs)
+	{
+		output = rhs;
+		return false;
 	}
 };
 
-int run_droid(Computer &c, int input)
+int run_droid(Computer<DroidIO> &c, int input)
 {
-	while (!c.done) {
-		int opcode = static_cast<int>(c.memory[c.pc]);
-
-		int pmode1 = (opcode / 100) % 10;
-		int pmode2 = (opcode / 1000) % 10;
-		int pmode3 = (opcode / 10000) % 10;
-
-		opcode = opcode % 100;
-
-		switch (opcode) {
-		case 1:
-		case 2:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-				long long op2 = c.get_arg(c.memory[c.pc + 2], pmode2);
-				long long dst3 = c.memory[c.pc + 3];
-
-				if (opcode == 1) {
-					c.set_arg(dst3, pmode3, op1 + op2);
-				}
-				else {
-					c.set_arg(dst3, pmode3, op1 * op2);
-				}
-
-				c.pc += 4;
-			}
-			break;
-		case 3:
-			{
-				long long dst1 = c.memory[c.pc + 1];
+	c.io.input = input;
 
-				c.set_arg(dst1, pmode1, input);
-
-				c.pc += 2;
-			}
-			break;
-		case 4:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-
-				c.pc += 2;
-
-				return static_cast<int>(op1);
-			}
-			break;
-		case 5:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-				long long op2 = c.get_arg(c.memory[c.pc + 2], pmode2);
-
-				if (op1) {
-					c.pc = op2;
-				}
-				else {
-					c.pc += 3;
-				}
-			}
-			break;
-		case 6:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-				long long op2 = c.get_arg(c.memory[c.pc + 2], pmode2);
-
-				if (!op1) {
-					c.pc = op2;
-				}
-				else {
-					c.pc += 3;
-				}
-			}
-			break;
-		case 7:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-				long long op2 = c.get_arg(c.memory[c.pc + 2], pmode2);
-				long long dst3 = c.memory[c.pc + 3];
-
-				c.set_arg(dst3, pmode3, op1 < op2);
-
-				c.pc += 4;
-			}
-			break;
-		case 8:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-				long long op2 = c.get_arg(c.memory[c.pc + 2], pmode2);
-				long long dst3 = c.memory[c.pc + 3];
-
-				c.set_arg(dst3, pmode3, op1 == op2);
-
-				c.pc += 4;
-			}
-			break;
-		case 9:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-
-				c.base += op1;
-
-				c.pc += 2;
-			}
-			break;
-		case 99:
-			c.done = true;
-			break;
-		default:
-			std::cerr << "opcode error: " << opcode << std::endl;
-			exit(1);
-			break;
-		}
+	if (!c.run()) {
+		return -1;
 	}
 
-	return -1;
+	return static_cast<int>(c.io.output);
 }
 
-// Recursively discover map of the maze
-void discover_map(Computer &c, Map &map, int x, int y)
+// Recursively discover map of the maze, trying each move on a fork of the
+// droid so there is no need to move it back afterwards
+void discover_map(const Computer<DroidIO> &c, Map &map, int x, int y)
 {
-	if (map[{x, y + 1}] == 0) {
-		int north_reply = run_droid(c, 1);
-
-		map[{x, y + 1}] = north_reply + 1;
-
-		if (north_reply) {
-			discover_map(c, map, x, y + 1);
-
-			run_droid(c, 2);
-		}
-	}
-
-	if (map[{x, y - 1}] == 0) {
-		int south_reply = run_droid(c, 2);
-
-		map[{x, y - 1}] = south_reply + 1;
-
-		if (south_reply) {
-			discover_map(c, map, x, y - 1);
-
-			run_droid(c, 1);
-		}
-	}
-
-	if (map[{x - 1, y}] == 0) {
-		int west_reply = run_droid(c, 3);
+	static const int dx[] = { 0, 0, 0, -1, 1 };
+	static const int dy[] = { 0, 1, -1, 0, 0 };
 
-		map[{x - 1, y}] = west_reply + 1;
+	for (int dir = 1; dir <= 4; ++dir) {
+		int nx = x + dx[dir];
+		int ny = y + dy[dir];
 
-		if (west_reply) {
-			discover_map(c, map, x - 1, y);
+		if (map[{nx, ny}] == 0) {
+			Computer<DroidIO> next = c.fork();
 
-			run_droid(c, 4);
-		}
-	}
+			int reply = run_droid(next, dir);
 
-	if (map[{x + 1, y}] == 0) {
-		int east_reply = run_droid(c, 4);
+			map[{nx, ny}] = reply + 1;
 
-		map[{x + 1, y}] = east_reply + 1;
-
-		if (east_reply) {
-			discover_map(c, map, x + 1, y);
-
-			run_droid(c, 3);
+			if (reply) {
+				discover_map(next, map, nx, ny);
+			}
 		}
 	}
 }
@@ -301,7 +133,7 @@ int main(int argc, char *argv[])
 
 	std::vector<long long> program = read_program(argv[1]);
 
-	Computer c(program);
+	Computer<DroidIO> c(program);
 
 	Map map;
 
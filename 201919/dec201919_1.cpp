@@ -3,203 +3,51 @@
 //
 
 #include <algorithm>
-#include <array>
-#include <fstream>
+#include <cstddef>
 #include <iostream>
 #include <string>
 #include <utility>
 #include <vector>
 
-std::vector<long long> read_program(const char *filename)
-{
-	std::ifstream infile(filename);
+#include "../intcode/batch.h"
+#include "../intcode/intcode.h"
 
-	std::vector<long long> program;
-	long long code;
+constexpr std::size_t lanes = 8;
 
-	for (char sep = ','; sep == ',' && infile >> code; infile >> sep) {
-		program.push_back(code);
+int main(int argc, char *argv[])
+{
+	if (argc != 2) {
+		std::cerr << "no program file\n";
+		exit(1);
 	}
 
-	return program;
-}
-
-struct Computer {
-	std::vector<long long> memory;
-	long long pc = 0;
-	long long base = 0;
-	bool done = false;
+	std::vector<long long> program = read_program(argv[1]);
 
-	explicit Computer(std::vector<long long> program) : memory(std::move(program)) {}
+	std::vector<int> pulled(50 * 50);
 
-	long long get_arg(long long address, int mode) {
-		if (mode == 1) {
-			return address;
-		}
+	// Run the drone program for a batch of positions at a time
+	for (std::size_t first = 0; first < pulled.size(); first += lanes) {
+		BatchComputer<lanes> c(program);
 
-		if (mode == 2) {
-			address = base + address;
-		}
+		for (std::size_t l = 0; l < lanes; ++l) {
+			std::size_t i = std::min(first + l, pulled.size() - 1);
 
-		auto size = std::max(memory.size(), static_cast<size_t>(address) + 1);
-		if (size > memory.size()) {
-			memory.resize(size);
+			c.add_input(l, i % 50);
+			c.add_input(l, i / 50);
 		}
 
-		return memory[address];
-	}
-
-	void set_arg(long long address, int mode, long long value) {
-		if (mode == 2) {
-			address = base + address;
-		}
+		c.run();
 
-		auto size = std::max(memory.size(), static_cast<size_t>(address) + 1);
-		if (size > memory.size()) {
-			memory.resize(size);
+		for (std::size_t l = 0; l < lanes && first + l < pulled.size(); ++l) {
+			pulled[first + l] = static_cast<int>(c.output(l).at(0));
 		}
-
-		memory[address] = value;
 	}
-};
-
-int run_drone(Computer &c, int x, int y)
-{
-	bool first_coord = true;
-
-	while (!c.done) {
-		int opcode = static_cast<int>(c.memory[c.pc]);
-
-		int pmode1 = (opcode / 100) % 10;
-		int pmode2 = (opcode / 1000) % 10;
-		int pmode3 = (opcode / 10000) % 10;
-
-		opcode = opcode % 100;
-
-		switch (opcode) {
-		case 1:
-		case 2:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-				long long op2 = c.get_arg(c.memory[c.pc + 2], pmode2);
-				long long dst3 = c.memory[c.pc + 3];
-
-				if (opcode == 1) {
-					c.set_arg(dst3, pmode3, op1 + op2);
-				}
-				else {
-					c.set_arg(dst3, pmode3, op1 * op2);
-				}
-
-				c.pc += 4;
-			}
-			break;
-		case 3:
-			{
-				long long dst1 = c.memory[c.pc + 1];
-
-				c.set_arg(dst1, pmode1, first_coord ? x : y);
-
-				first_coord = !first_coord;
-
-				c.pc += 2;
-			}
-			break;
-		case 4:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-
-				c.pc += 2;
-
-				return static_cast<int>(op1);
-			}
-			break;
-		case 5:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-				long long op2 = c.get_arg(c.memory[c.pc + 2], pmode2);
-
-				if (op1) {
-					c.pc = op2;
-				}
-				else {
-					c.pc += 3;
-				}
-			}
-			break;
-		case 6:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-				long long op2 = c.get_arg(c.memory[c.pc + 2], pmode2);
-
-				if (!op1) {
-					c.pc = op2;
-				}
-				else {
-					c.pc += 3;
-				}
-			}
-			break;
-		case 7:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-				long long op2 = c.get_arg(c.memory[c.pc + 2], pmode2);
-				long long dst3 = c.memory[c.pc + 3];
-
-				c.set_arg(dst3, pmode3, op1 < op2);
-
-				c.pc += 4;
-			}
-			break;
-		case 8:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-				long long op2 = c.get_arg(c.memory[c.pc + 2], pmode2);
-				long long dst3 = c.memory[c.pc + 3];
-
-				c.set_arg(dst3, pmode3, op1 == op2);
-
-				c.pc += 4;
-			}
-			break;
-		case 9:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-
-				c.base += op1;
-
-				c.pc += 2;
-			}
-			break;
-		case 99:
-			c.done = true;
-			break;
-		default:
-			std::cerr << "opcode error: " << opcode << std::endl;
-			exit(1);
-			break;
-		}
-	}
-
-	return -1;
-}
-
-int main(int argc, char *argv[])
-{
-	if (argc != 2) {
-		std::cerr << "no program file\n";
-		exit(1);
-	}
-
-	std::vector<long long> program = read_program(argv[1]);
 
 	int num_pulled = 0;
 
 	for (int y = 0; y < 50; ++y) {
 		for (int x = 0; x < 50; ++x) {
-			Computer c(program);
-
-			int res = run_drone(c, x, y);
+			int res = pulled[y * 50 + x];
 
 			std::cout << (res ? '#' : '.');
 
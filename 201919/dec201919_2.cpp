@@ -2,15 +2,32 @@
 // Advent of Code 2019, day 19, part two
 //
 
+// The answer is found by following the left and right edges of the beam
+// down one row at a time, which takes a few probes per row.
+//
+// There is also a search that scans whole rows and columns, running the
+// probes on a pool of threads with the results kept in a cache shared by
+// the threads. Pass a number of threads N after the program file to run
+// it with 1 to N threads as well, and get probe statistics for each on
+// stderr.
+
 #include <algorithm>
 #include <array>
-#include <fstream>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <functional>
 #include <iostream>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "../intcode/intcode.h"
+
 struct PairHash {
 	template<typename T1, typename T2>
 	std::size_t operator()(const std::pair<T1, T2> &p) const noexcept
@@ -22,233 +39,409 @@ struct PairHash {
 	}
 };
 
-std::vector<long long> read_program(const char *filename)
-{
-	std::ifstream infile(filename);
+struct DroneIO {
+	int x = 0;
+	int y = 0;
+	bool first_coord = true;
+	long long output = -1;
 
-	std::vector<long long> program;
-	long long code;
+	bool operator>>(long long &rhs)
+	{
+		rhs = first_coord ? x : y;
+
+		first_coord = !first_coord;
 
-	for (char sep = ','; sep == ',' && infile >> code; infile >> sep) {
-		program.push_back(code);
+		return true;
 	}
 
-	return program;
-}
+	bool operator<<(long long rhs)
+	{
+		output = rhs;
+		return false;
+	}
+};
 
-struct Computer {
-	std::vector<long long> memory;
-	long long pc = 0;
-	long long base = 0;
-	bool done = false;
+int run_drone(Computer<DroneIO> &c, int x, int y)
+{
+	c.io.x = x;
+	c.io.y = y;
+	c.io.first_coord = true;
 
-	explicit Computer(std::vector<long long> program) : memory(std::move(program)) {}
+	if (!c.run()) {
+		return -1;
+	}
 
-	long long get_arg(long long address, int mode) {
-		if (mode == 1) {
-			return address;
-		}
+	return static_cast<int>(c.io.output);
+}
 
-		if (mode == 2) {
-			address = base + address;
+// Fixed set of threads that run parallel_for() jobs, with the calling
+// thread helping out
+class ThreadPool {
+public:
+	explicit ThreadPool(unsigned int num_threads)
+	{
+		for (unsigned int i = 1; i < num_threads; ++i) {
+			workers.emplace_back([this] { work(); });
 		}
+	}
 
-		auto size = std::max(memory.size(), static_cast<size_t>(address) + 1);
-		if (size > memory.size()) {
-			memory.resize(size);
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
 		}
 
-		return memory[address];
-	}
+		start_cv.notify_all();
 
-	void set_arg(long long address, int mode, long long value) {
-		if (mode == 2) {
-			address = base + address;
+		for (auto &t : workers) {
+			t.join();
 		}
+	}
+
+	unsigned int size() const { return static_cast<unsigned int>(workers.size()) + 1; }
 
-		auto size = std::max(memory.size(), static_cast<size_t>(address) + 1);
-		if (size > memory.size()) {
-			memory.resize(size);
+	// Call fn(i) for i from 0 to n - 1 on the threads, and wait for all
+	// calls to finish
+	void parallel_for(int n, const std::function<void(int)> &fn)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job = &fn;
+			job_size = n;
+			next = 0;
+			busy = static_cast<int>(workers.size());
+			++generation;
 		}
 
-		memory[address] = value;
-	}
-};
+		start_cv.notify_all();
 
-int run_drone(Computer &c, int x, int y)
-{
-	bool first_coord = true;
+		run_job(fn, n);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		done_cv.wait(lock, [this] { return busy == 0; });
+		job = nullptr;
+	}
 
-	while (!c.done) {
-		int opcode = static_cast<int>(c.memory[c.pc]);
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable start_cv;
+	std::condition_variable done_cv;
+	const std::function<void(int)> *job = nullptr;
+	int job_size = 0;
+	std::atomic<int> next{0};
+	int busy = 0;
+	unsigned int generation = 0;
+	bool stop = false;
+
+	void run_job(const std::function<void(int)> &fn, int n)
+	{
+		for (int i = next++; i < n; i = next++) {
+			fn(i);
+		}
+	}
 
-		int pmode1 = (opcode / 100) % 10;
-		int pmode2 = (opcode / 1000) % 10;
-		int pmode3 = (opcode / 10000) % 10;
+	void work()
+	{
+		unsigned int seen = 0;
 
-		opcode = opcode % 100;
+		for (;;) {
+			const std::function<void(int)> *fn;
+			int n;
 
-		switch (opcode) {
-		case 1:
-		case 2:
 			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-				long long op2 = c.get_arg(c.memory[c.pc + 2], pmode2);
-				long long dst3 = c.memory[c.pc + 3];
+				std::unique_lock<std::mutex> lock(mutex);
+				start_cv.wait(lock, [&] { return stop || generation != seen; });
 
-				if (opcode == 1) {
-					c.set_arg(dst3, pmode3, op1 + op2);
-				}
-				else {
-					c.set_arg(dst3, pmode3, op1 * op2);
+				if (stop) {
+					return;
 				}
 
-				c.pc += 4;
+				seen = generation;
+				fn = job;
+				n = job_size;
 			}
-			break;
-		case 3:
-			{
-				long long dst1 = c.memory[c.pc + 1];
 
-				c.set_arg(dst1, pmode1, first_coord ? x : y);
+			run_job(*fn, n);
 
-				first_coord = !first_coord;
+			std::lock_guard<std::mutex> lock(mutex);
 
-				c.pc += 2;
+			if (--busy == 0) {
+				done_cv.notify_one();
 			}
-			break;
-		case 4:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
+		}
+	}
+};
 
-				c.pc += 2;
+// Probe results shared between threads, split into shards with a lock
+// each so threads seldom wait on each other
+class ProbeCache {
+public:
+	bool find(int x, int y, int &res)
+	{
+		Shard &shard = shard_for(x, y);
+		std::lock_guard<std::mutex> lock(shard.mutex);
 
-				return static_cast<int>(op1);
-			}
-			break;
-		case 5:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-				long long op2 = c.get_arg(c.memory[c.pc + 2], pmode2);
+		if (auto it = shard.map.find({x, y}); it != shard.map.end()) {
+			res = it->second;
+			return true;
+		}
 
-				if (op1) {
-					c.pc = op2;
-				}
-				else {
-					c.pc += 3;
-				}
-			}
-			break;
-		case 6:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-				long long op2 = c.get_arg(c.memory[c.pc + 2], pmode2);
+		return false;
+	}
 
-				if (!op1) {
-					c.pc = op2;
-				}
-				else {
-					c.pc += 3;
+	void insert(int x, int y, int res)
+	{
+		Shard &shard = shard_for(x, y);
+		std::lock_guard<std::mutex> lock(shard.mutex);
+
+		shard.map[{x, y}] = res;
+	}
+
+private:
+	struct Shard {
+		std::mutex mutex;
+		std::unordered_map<std::pair<int, int>, int, PairHash> map;
+	};
+
+	std::array<Shard, 64> shards;
+
+	Shard &shard_for(int x, int y)
+	{
+		return shards[PairHash()(std::make_pair(x, y)) % shards.size()];
+	}
+};
+
+// Each probe runs on a fork of one computer loaded with the program,
+// which the threads share. The computer starts with the instructions
+// decoded by a probe, so the forks do not decode them again.
+class BeamScanner {
+public:
+	BeamScanner(const std::vector<long long> &program, unsigned int num_threads)
+	 : drone(warm_drone(program)), pool(num_threads) {}
+
+	int probe(int x, int y)
+	{
+		int res;
+
+		if (cache.find(x, y, res)) {
+			return res;
+		}
+
+		Computer<DroneIO> c = drone.fork();
+
+		res = run_drone(c, x, y);
+
+		++num_probes;
+
+		cache.insert(x, y, res);
+
+		return res;
+	}
+
+	// Probe x from x_first to x_last - 1 on row y
+	std::vector<int> row(int y, int x_first, int x_last)
+	{
+		std::vector<int> res(std::max(x_last - x_first, 0));
+
+		pool.parallel_for(static_cast<int>(res.size()), [&](int i) {
+			res[i] = probe(x_first + i, y);
+		});
+
+		return res;
+	}
+
+	// Probe y from y_first to y_last - 1 on column x
+	std::vector<int> column(int x, int y_first, int y_last)
+	{
+		std::vector<int> res(std::max(y_last - y_first, 0));
+
+		pool.parallel_for(static_cast<int>(res.size()), [&](int i) {
+			res[i] = probe(x, y_first + i);
+		});
+
+		return res;
+	}
+
+	long long probes() const { return num_probes; }
+	unsigned int threads() const { return pool.size(); }
+
+private:
+	const Computer<DroneIO> drone;
+	ProbeCache cache;
+	std::atomic<long long> num_probes{0};
+	ThreadPool pool;
+
+	static Computer<DroneIO> warm_drone(const std::vector<long long> &program)
+	{
+		Computer<DroneIO> drone(program);
+		Computer<DroneIO> warm = drone.fork();
+
+		run_drone(warm, 0, 0);
+
+		drone.share_decoded(warm);
+
+		return drone;
+	}
+};
+
+// Find top left corner of the first 100x100 square inside the beam
+std::pair<int, int> find_square(BeamScanner &scanner)
+{
+	// The image from part one showed there are a few empty lines at
+	// the top, so start the scan at line 5. Also the beam is above
+	// the diagonal after 50, 50, so start the x search at y, or where
+	// the beam started on the row before if that is further right.
+	int prev_x = 0;
+	int prev_width = 0;
+
+	for (int y = 5; y < 100000; ++y) {
+		int x_first = std::max(y, prev_x);
+
+		// Scan a growing range of the row until it contains both
+		// edges of the beam, giving up on rows where it is too narrow
+		// to show up. The beam widens slowly, so start with a little
+		// more than the width on the row before.
+		int x = -1;
+		int width = 0;
+
+		for (int span = std::max(prev_width + 8, 16); ; span *= 2) {
+			std::vector<int> row = scanner.row(y, x_first, x_first + span);
+
+			auto first = std::find(row.begin(), row.end(), 1);
+
+			if (first == row.end()) {
+				if (span > 4 * y) {
+					break;
 				}
+
+				continue;
 			}
-			break;
-		case 7:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-				long long op2 = c.get_arg(c.memory[c.pc + 2], pmode2);
-				long long dst3 = c.memory[c.pc + 3];
 
-				c.set_arg(dst3, pmode3, op1 < op2);
+			auto last = std::find(first, row.end(), 0);
 
-				c.pc += 4;
+			if (last != row.end()) {
+				x = x_first + static_cast<int>(first - row.begin());
+				width = static_cast<int>(last - first);
+				break;
 			}
-			break;
-		case 8:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
-				long long op2 = c.get_arg(c.memory[c.pc + 2], pmode2);
-				long long dst3 = c.memory[c.pc + 3];
+		}
 
-				c.set_arg(dst3, pmode3, op1 == op2);
+		if (x == -1) {
+			continue;
+		}
 
-				c.pc += 4;
-			}
-			break;
-		case 9:
-			{
-				long long op1 = c.get_arg(c.memory[c.pc + 1], pmode1);
+		prev_x = x;
+		prev_width = width;
+
+		// Check columns a quarter of the square at a time, since most
+		// columns leave the beam early
+		for (int w = 0; w <= width - 100; ++w) {
+			int height = 0;
 
-				c.base += op1;
+			while (height < 100) {
+				std::vector<int> column = scanner.column(x + w, y + height, y + height + 25);
 
-				c.pc += 2;
+				if (std::find(column.begin(), column.end(), 0) != column.end()) {
+					break;
+				}
+
+				height += 25;
+			}
+
+			if (height >= 100) {
+				return {x + w, y};
 			}
-			break;
-		case 99:
-			c.done = true;
-			break;
-		default:
-			std::cerr << "opcode error: " << opcode << std::endl;
-			exit(1);
-			break;
 		}
 	}
 
-	return -1;
+	return {-1, -1};
 }
 
-int is_inside_beam(const std::vector<long long> &program, int x, int y)
+// Find top left corner of the first 100x100 square inside the beam by
+// tracking the edges of the beam. The square with its bottom left corner
+// on the left edge of row y fits if the right edge of the row 99 above is
+// at least 99 further right, and since the left edge only moves right
+// that is also the leftmost square with its top on that row.
+std::pair<int, int> track_square(BeamScanner &scanner)
 {
-	static std::unordered_map<std::pair<int, int>, int, PairHash> mem;
+	std::vector<int> right;
+	int left = 0;
 
-	if (auto it = mem.find({x, y}); it != mem.end()) {
-		return (*it).second;
-	}
+	for (int y = 0; y < 100000; ++y) {
+		// Find the left edge, starting from the one on the row before,
+		// giving up on rows where the beam is too narrow to show up
+		int x = left;
+
+		while (x <= 4 * y + 10 && !scanner.probe(x, y)) {
+			++x;
+		}
 
-	Computer c(program);
+		if (x > 4 * y + 10) {
+			right.push_back(-1);
+			continue;
+		}
+
+		left = x;
 
-	int res = run_drone(c, x, y);
+		// Find the right edge, starting from the one on the row before
+		int r = std::max(x, right.empty() ? 0 : right.back());
 
-	mem[{x, y}] = res;
+		while (r > x && !scanner.probe(r, y)) {
+			--r;
+		}
+
+		while (scanner.probe(r + 1, y)) {
+			++r;
+		}
+
+		right.push_back(r);
+
+		if (y >= 99 && right[y - 99] >= x + 99) {
+			return {x, y - 99};
+		}
+	}
 
-	return res;
+	return {-1, -1};
 }
 
 int main(int argc, char *argv[])
 {
-	if (argc != 2) {
+	if (argc != 2 && argc != 3) {
 		std::cerr << "no program file\n";
 		exit(1);
 	}
 
 	std::vector<long long> program = read_program(argv[1]);
 
-	// The image from part one showed there are a few empty lines at
-	// the top, so start the scan at line 5. Also the beam is above
-	// the diagonal after 50, 50, so start the x search at y.
-	for (int y = 5; y < 100000; ++y) {
-		int x = y;
+	BeamScanner tracker(program, 1);
 
-		while (!is_inside_beam(program, x, y)) {
-			++x;
-		}
+	auto start = std::chrono::steady_clock::now();
 
-		int width = 0;
+	auto [x, y] = track_square(tracker);
 
-		while (is_inside_beam(program, x + width, y)) {
-			++width;
-		}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
 
-		for (int w = 0; w <= width - 100; ++w) {
-			int height = 0;
+	std::cout << x * 10000 + y << '\n';
 
-			while (is_inside_beam(program, x + w, y + height)) {
-				++height;
-			}
+	if (argc == 3) {
+		std::cerr << "edge tracking: " << tracker.probes() << " probes in " << elapsed.count() << " s\n";
 
-			if (height >= 100) {
-				std::cout << (x + w) * 10000 + y << '\n';
-				exit(0);
-			}
+		int max_threads = std::max(std::stoi(argv[2]), 1);
+
+		for (int num_threads = 1; num_threads <= max_threads; ++num_threads) {
+			BeamScanner scanner(program, static_cast<unsigned int>(num_threads));
+
+			start = std::chrono::steady_clock::now();
+
+			auto [scan_x, scan_y] = find_square(scanner);
+
+			elapsed = std::chrono::steady_clock::now() - start;
+
+			std::cerr << "scan: " << scan_x * 10000 + scan_y << ", " << scanner.threads() << " threads, "
+			          << scanner.probes() << " probes in " << elapsed.count() << " s, "
+			          << scanner.probes() / elapsed.count() << " probes/s\n";
 		}
 	}
 
@@ -2,262 +2,431 @@
 // Advent of Code 2019, day 23, part two
 //
 
+// Each computer runs until it sends a packet or blocks waiting for one,
+// and a blocked computer is only run again when a packet arrives for it.
+// A computer reading from an empty queue gets -1 once, and blocks if it
+// reads from the empty queue again. When no computer is ready to run, the
+// network is idle, and the NAT sends its packet to address 0.
+//
+// Pass a number of threads after the program file to run the computers on
+// that many threads, and get packet statistics on stderr. Packets are sent
+// through lock-free mailboxes, and a count of computers that are ready or
+// running tells when the network is idle.
+
 #include <algorithm>
-#include <fstream>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <iostream>
+#include <mutex>
 #include <queue>
 #include <string>
+#include <thread>
 #include <tuple>
 #include <unordered_set>
 #include <utility>
 #include <vector>
 
-std::vector<long long> read_program(const char *filename)
-{
-	std::ifstream infile(filename);
+#include "../intcode/intcode.h"
 
-	std::vector<long long> program;
-	long long code;
+constexpr int num_nodes = 50;
+constexpr long long nat_address = 255;
 
-	for (char sep = ','; sep == ',' && infile >> code; infile >> sep) {
-		program.push_back(code);
-	}
+// Queue that any number of threads can push to, and one thread takes
+// from. Pushing adds a node to a lock-free stack, and the consumer takes
+// the whole stack at once, so there is no ABA problem.
+template<typename T>
+class Mailbox {
+public:
+	Mailbox() = default;
 
-	return program;
-}
+	// Only for moving mailboxes that no other thread uses yet
+	Mailbox(Mailbox &&other) noexcept : head(other.head.exchange(nullptr)) {}
 
-template<typename IODevice>
-class Computer {
-	std::vector<long long> memory;
-	long long pc = 0;
-	long long base = 0;
-	bool halt = false;
-	bool booted = false;
-	int id = 0;
-
-	long long get_arg(long long address, int mode) {
-		if (mode == 1) {
-			return address;
-		}
+	Mailbox(const Mailbox &) = delete;
+	Mailbox &operator=(const Mailbox &) = delete;
 
-		if (mode == 2) {
-			address = base + address;
+	~Mailbox()
+	{
+		for (Node *node = head.load(); node != nullptr; ) {
+			Node *next = node->next;
+			delete node;
+			node = next;
 		}
+	}
 
-		auto size = std::max(memory.size(), static_cast<size_t>(address) + 1);
-		if (size > memory.size()) {
-			memory.resize(size);
-		}
+	void push(T value)
+	{
+		Node *node = new Node{std::move(value), head.load(std::memory_order_relaxed)};
 
-		return memory[address];
+		while (!head.compare_exchange_weak(node->next, node)) {}
 	}
 
-	void set_arg(long long address, int mode, long long value) {
-		if (mode == 2) {
-			address = base + address;
-		}
+	bool empty() const { return head.load() == nullptr; }
 
-		auto size = std::max(memory.size(), static_cast<size_t>(address) + 1);
-		if (size > memory.size()) {
-			memory.resize(size);
+	// Move all values to the back of out in the order they were pushed
+	template<typename Queue>
+	void take(Queue &out)
+	{
+		Node *node = head.exchange(nullptr);
+		Node *prev = nullptr;
+
+		while (node != nullptr) {
+			Node *next = node->next;
+			node->next = prev;
+			prev = node;
+			node = next;
 		}
 
-		memory[address] = value;
+		while (prev != nullptr) {
+			Node *next = prev->next;
+			out.push(std::move(prev->value));
+			delete prev;
+			prev = next;
+		}
 	}
 
-public:
-	IODevice io;
-
-	Computer(std::vector<long long> program, int addr)
-	 : memory(std::move(program)), id(addr) {}
+private:
+	struct Node {
+		T value;
+		Node *next;
+	};
 
-	void step();
-	void run() { while (!halt) { step(); } }
+	std::atomic<Node *> head{nullptr};
 };
 
-template<typename IODevice>
-void Computer<IODevice>::step()
-{
-	if (halt) {
-		return;
-	}
+struct NetworkIO {
+	Mailbox<std::pair<long long, long long>> packets_in;
+	std::queue<std::pair<long long, long long>> packets;
+	std::queue<std::tuple<long long, long long, long long>> packets_out;
+	std::queue<long long> input;
+	std::vector<long long> output;
+	bool starved = false;
 
-	int opcode = static_cast<int>(memory[pc]);
+	bool operator>>(long long &rhs)
+	{
+		if (input.empty()) {
+			if (packets.empty()) {
+				packets_in.take(packets);
+			}
 
-	int pmode1 = (opcode / 100) % 10;
-	int pmode2 = (opcode / 1000) % 10;
-	int pmode3 = (opcode / 10000) % 10;
+			if (packets.empty()) {
+				if (starved) {
+					return false;
+				}
 
-	opcode = opcode % 100;
+				rhs = -1;
 
-	switch (opcode) {
-	case 1:
-	case 2:
-		{
-			long long op1 = get_arg(memory[pc + 1], pmode1);
-			long long op2 = get_arg(memory[pc + 2], pmode2);
-			long long dst3 = memory[pc + 3];
+				starved = true;
 
-			if (opcode == 1) {
-				set_arg(dst3, pmode3, op1 + op2);
-			}
-			else {
-				set_arg(dst3, pmode3, op1 * op2);
+				return true;
 			}
 
-			pc += 4;
+			auto [x, y] = packets.front();
+			packets.pop();
+
+			input.push(x);
+			input.push(y);
 		}
-		break;
-	case 3:
-		{
-			long long dst1 = memory[pc + 1];
 
-			if (!booted) {
-				set_arg(dst1, pmode1, id);
+		starved = false;
 
-				booted = true;
+		rhs = input.front();
+		input.pop();
 
-				pc += 2;
+		return true;
+	}
 
-				break;
-			}
+	bool operator<<(long long rhs)
+	{
+		output.push_back(rhs);
 
-			long long value = 0;
+		if (output.size() == 3) {
+			packets_out.push({output[0], output[1], output[2]});
+			output.clear();
 
-			io >> value;
+			return false;
+		}
 
-			set_arg(dst1, pmode1, value);
+		return true;
+	}
 
-			pc += 2;
-		}
-		break;
-	case 4:
-		{
-			long long op1 = get_arg(memory[pc + 1], pmode1);
+	// The first input is the network address of the computer
+	explicit NetworkIO(int addr) { input.push(addr); }
+};
 
-			io << op1;
+void check_address(long long addr)
+{
+	if ((addr < 0 || addr >= num_nodes) && addr != nat_address) {
+		std::cerr << "packet to unknown address " << addr << '\n';
+		exit(1);
+	}
+}
 
-			pc += 2;
+// Run the network on one thread, returns the first y value the NAT sends
+// twice in a row
+long long run_network(std::vector<Computer<NetworkIO>> &computers)
+{
+	// Computers that can run, and whether each is blocked on input
+	std::deque<int> ready;
+	std::vector<bool> blocked(num_nodes, false);
+
+	for (int i = 0; i < num_nodes; ++i) {
+		ready.push_back(i);
+	}
+
+	auto deliver = [&](int addr, std::pair<long long, long long> packet) {
+		computers[addr].io.packets_in.push(packet);
+
+		if (blocked[addr]) {
+			blocked[addr] = false;
+			ready.push_back(addr);
 		}
-		break;
-	case 5:
-		{
-			long long op1 = get_arg(memory[pc + 1], pmode1);
-			long long op2 = get_arg(memory[pc + 2], pmode2);
+	};
+
+	std::pair<long long, long long> nat_package = {-1, -1};
+
+	std::unordered_set<long long> nat_y_seen;
+
+	for (;;) {
+		while (!ready.empty()) {
+			int i = ready.front();
+			ready.pop_front();
 
-			if (op1) {
-				pc = op2;
+			bool running = computers[i].run();
+
+			auto &packets_out = computers[i].io.packets_out;
+
+			if (packets_out.empty()) {
+				// Halted computers stay blocked for good
+				blocked[i] = true;
+				continue;
 			}
-			else {
-				pc += 3;
+
+			while (!packets_out.empty()) {
+				auto [addr, x, y] = packets_out.front();
+				packets_out.pop();
+
+				check_address(addr);
+
+				if (addr == nat_address) {
+					nat_package = {x, y};
+				}
+				else {
+					deliver(static_cast<int>(addr), {x, y});
+				}
 			}
-		}
-		break;
-	case 6:
-		{
-			long long op1 = get_arg(memory[pc + 1], pmode1);
-			long long op2 = get_arg(memory[pc + 2], pmode2);
 
-			if (!op1) {
-				pc = op2;
+			if (running) {
+				ready.push_back(i);
 			}
 			else {
-				pc += 3;
+				blocked[i] = true;
 			}
 		}
-		break;
-	case 7:
-		{
-			long long op1 = get_arg(memory[pc + 1], pmode1);
-			long long op2 = get_arg(memory[pc + 2], pmode2);
-			long long dst3 = memory[pc + 3];
 
-			set_arg(dst3, pmode3, op1 < op2);
+		// Every computer is blocked waiting for input, so the network
+		// is idle
+		if (nat_package.first == -1) {
+			std::cerr << "network idle with no NAT packet\n";
+			exit(1);
+		}
 
-			pc += 4;
+		if (auto [it, success] = nat_y_seen.insert(nat_package.second); !success) {
+			return nat_package.second;
 		}
-		break;
-	case 8:
-		{
-			long long op1 = get_arg(memory[pc + 1], pmode1);
-			long long op2 = get_arg(memory[pc + 2], pmode2);
-			long long dst3 = memory[pc + 3];
 
-			set_arg(dst3, pmode3, op1 == op2);
+		deliver(0, nat_package);
+	}
+}
 
-			pc += 4;
+// Network with the computers run on a number of threads. A computer is
+// either blocked, or queued or running on one thread. The number of
+// computers that are not blocked is counted, and a computer only leaves
+// that count after any packets it sent were delivered, so when it drops
+// to zero, the network is idle.
+class ThreadedNetwork {
+public:
+	explicit ThreadedNetwork(std::vector<Computer<NetworkIO>> &computers)
+	 : computers(computers), states(computers.size()) {}
+
+	// Run on num_threads threads, returns the first y value the NAT
+	// sends twice in a row
+	long long run(unsigned int num_threads)
+	{
+		active = static_cast<int>(computers.size());
+
+		for (std::size_t i = 0; i < computers.size(); ++i) {
+			states[i] = State::queued;
+			ready.push_back(static_cast<int>(i));
 		}
-		break;
-	case 9:
-		{
-			long long op1 = get_arg(memory[pc + 1], pmode1);
 
-			base += op1;
+		std::vector<std::thread> workers;
 
-			pc += 2;
+		for (unsigned int i = 1; i < num_threads; ++i) {
+			workers.emplace_back([this] { work(); });
 		}
-		break;
-	case 99:
-		halt = true;
-		break;
-	default:
-		std::cerr << "opcode error: " << opcode << std::endl;
-		exit(1);
-		break;
+
+		work();
+
+		for (auto &t : workers) {
+			t.join();
+		}
+
+		return result;
 	}
-}
 
-struct NetworkIO {
-	std::queue<std::pair<long long, long long>> packets_in;
-	std::queue<std::tuple<long long, long long, long long>> packets_out;
-	std::queue<long long> input;
-	std::vector<long long> output;
-	bool idle = false;
+	long long packets() const { return num_packets; }
 
-	bool operator>>(long long &rhs)
+private:
+	enum class State { blocked, queued };
+
+	std::vector<Computer<NetworkIO>> &computers;
+	std::vector<std::atomic<State>> states;
+	std::atomic<int> active{0};
+	std::atomic<long long> num_packets{0};
+
+	std::mutex ready_mutex;
+	std::condition_variable ready_cv;
+	std::deque<int> ready;
+	bool done = false;
+
+	std::mutex nat_mutex;
+	std::pair<long long, long long> nat_package = {-1, -1};
+	std::unordered_set<long long> nat_y_seen;
+	long long result = -1;
+
+	void enqueue(int i)
 	{
-		idle = false;
+		{
+			std::lock_guard<std::mutex> lock(ready_mutex);
+			ready.push_back(i);
+		}
 
-		if (input.empty()) {
-			if (packets_in.empty()) {
-				rhs = -1;
+		ready_cv.notify_one();
+	}
+
+	// The push to the mailbox and the load of the state here, and the
+	// store of the state and the check of the mailbox in run_node(), are
+	// sequentially consistent, so either this sees the computer blocked,
+	// or the computer sees the packet
+	void deliver(int addr, std::pair<long long, long long> packet)
+	{
+		computers[addr].io.packets_in.push(packet);
 
-				idle = true;
+		State expected = State::blocked;
 
-				return true;
+		if (states[addr].compare_exchange_strong(expected, State::queued)) {
+			++active;
+			enqueue(addr);
+		}
+	}
+
+	void work()
+	{
+		for (;;) {
+			int i;
+
+			{
+				std::unique_lock<std::mutex> lock(ready_mutex);
+				ready_cv.wait(lock, [this] { return done || !ready.empty(); });
+
+				if (done) {
+					return;
+				}
+
+				i = ready.front();
+				ready.pop_front();
 			}
 
-			auto [x, y] = packets_in.front();
-			packets_in.pop();
+			run_node(i);
+		}
+	}
 
-			input.push(x);
-			input.push(y);
+	void run_node(int i)
+	{
+		bool running = computers[i].run();
+
+		auto &packets_out = computers[i].io.packets_out;
+
+		bool sent = !packets_out.empty();
+
+		while (!packets_out.empty()) {
+			auto [addr, x, y] = packets_out.front();
+			packets_out.pop();
+
+			check_address(addr);
+
+			++num_packets;
+
+			if (addr == nat_address) {
+				std::lock_guard<std::mutex> lock(nat_mutex);
+				nat_package = {x, y};
+			}
+			else {
+				deliver(static_cast<int>(addr), {x, y});
+			}
 		}
 
-		rhs = input.front();
-		input.pop();
+		if (sent && running) {
+			enqueue(i);
+			return;
+		}
 
-		return true;
+		states[i] = State::blocked;
+
+		if (!computers[i].io.packets_in.empty()) {
+			State expected = State::blocked;
+
+			if (states[i].compare_exchange_strong(expected, State::queued)) {
+				enqueue(i);
+				return;
+			}
+		}
+
+		if (--active == 0) {
+			idle();
+		}
 	}
 
-	bool operator<<(long long rhs)
+	// Called by the thread that saw the network go idle, so no computers
+	// are running
+	void idle()
 	{
-		idle = false;
+		std::pair<long long, long long> packet;
 
-		output.push_back(rhs);
+		{
+			std::lock_guard<std::mutex> lock(nat_mutex);
 
-		if (output.size() == 3) {
-			packets_out.push({output[0], output[1], output[2]});
-			output.clear();
+			if (nat_package.first == -1) {
+				std::cerr << "network idle with no NAT packet\n";
+				exit(1);
+			}
+
+			if (auto [it, success] = nat_y_seen.insert(nat_package.second); !success) {
+				result = nat_package.second;
+
+				{
+					std::lock_guard<std::mutex> lock(ready_mutex);
+					done = true;
+				}
+
+				ready_cv.notify_all();
+
+				return;
+			}
+
+			packet = nat_package;
 		}
 
-		return true;
+		deliver(0, packet);
 	}
 };
 
 int main(int argc, char *argv[])
 {
-	if (argc != 2) {
+	if (argc != 2 && argc != 3) {
 		std::cerr << "no program file\n";
 		exit(1);
 	}
@@ -266,48 +435,28 @@ int main(int argc, char *argv[])
 
 	std::vector<Computer<NetworkIO>> computers;
 
-	computers.reserve(50);
+	computers.reserve(num_nodes);
 
-	for (int i = 0; i < 50; ++i) {
+	for (int i = 0; i < num_nodes; ++i) {
 		computers.emplace_back(program, i);
 	}
 
-	std::pair<long long, long long> nat_package = {-1, -1};
+	if (argc == 3) {
+		unsigned int num_threads = std::max(std::stoi(argv[2]), 1);
 
-	std::unordered_set<long long> nat_y_seen;
+		ThreadedNetwork network(computers);
 
-	for (;;) {
-		int num_idle = 0;
-
-		for (int i = 0; i < 50; ++i) {
-			computers[i].step();
-
-			if (!computers[i].io.packets_out.empty()) {
-				auto [addr, x, y] = computers[i].io.packets_out.front();
-				computers[i].io.packets_out.pop();
+		auto start = std::chrono::steady_clock::now();
 
-				if (addr == 255) {
-					nat_package = {x, y};
-				}
-				else {
-					computers[addr].io.packets_in.push({x, y});
-				}
-			}
-			else {
-				if (computers[i].io.packets_in.empty()) {
-					num_idle += computers[i].io.idle;
-				}
-			}
-		}
+		std::cout << network.run(num_threads) << '\n';
 
-		if (num_idle == 50 && nat_package.first != -1) {
-			if (auto [it, success] = nat_y_seen.insert(nat_package.second); !success) {
-				std::cout << nat_package.second << '\n';
-				exit(0);
-			}
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
 
-			computers[0].io.packets_in.push(nat_package);
-		}
+		std::cerr << num_threads << " threads, " << network.packets() << " packets in "
+		          << elapsed.count() << " s, " << network.packets() / elapsed.count() << " packets/s\n";
+	}
+	else {
+		std::cout << run_network(computers) << '\n';
 	}
 
 	return 0;
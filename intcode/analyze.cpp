@@ -0,0 +1,231 @@
+//
+// Print the control flow graph of an Intcode program
+//
+
+// Usage: analyze PROGRAM [PROFILE] > program.json
+//
+// Writes the basic blocks, functions and self-modifying writes found by
+// the control flow graph in cfg.h as JSON.
+//
+// PROFILE is a CSV profile of a run of the program, see profile.h. With
+// it, each block also gets the number of times it was entered and the
+// number of instructions executed in it, and the hottest blocks are
+// listed on stderr.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "cfg.h"
+#include "intcode.h"
+
+// Read hit counts per pc from a CSV profile
+std::unordered_map<long long, long long> read_profile(const char *filename)
+{
+	std::ifstream infile(filename);
+
+	if (!infile) {
+		std::cerr << "unable to open profile " << filename << '\n';
+		exit(1);
+	}
+
+	std::unordered_map<long long, long long> hits;
+
+	for (std::string line; std::getline(infile, line); ) {
+		if (line.compare(0, 3, "pc,") != 0) {
+			continue;
+		}
+
+		std::istringstream ss(line.substr(3));
+		long long pc, opcode, count;
+		char sep;
+
+		if (ss >> pc >> sep >> opcode >> sep >> count) {
+			hits[pc] = count;
+		}
+	}
+
+	return hits;
+}
+
+template<typename T>
+void write_list(std::ostream &os, const std::vector<T> &values)
+{
+	os << '[';
+
+	for (std::size_t i = 0; i < values.size(); ++i) {
+		os << (i ? ", " : "") << values[i];
+	}
+
+	os << ']';
+}
+
+// Write s as a JSON string, escaping quotes, backslashes and control
+// characters
+void write_string(std::ostream &os, const std::string &s)
+{
+	os << '"';
+
+	for (char ch : s) {
+		switch (ch) {
+		case '"': os << "\\\""; break;
+		case '\\': os << "\\\\"; break;
+		case '\b': os << "\\b"; break;
+		case '\f': os << "\\f"; break;
+		case '\n': os << "\\n"; break;
+		case '\r': os << "\\r"; break;
+		case '\t': os << "\\t"; break;
+		default:
+			if (static_cast<unsigned char>(ch) < 0x20) {
+				os << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+				   << static_cast<int>(ch) << std::dec << std::setfill(' ');
+			}
+			else {
+				os << ch;
+			}
+			break;
+		}
+	}
+
+	os << '"';
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2 || argc > 3) {
+		std::cerr << "usage: analyze PROGRAM [PROFILE]\n";
+		exit(1);
+	}
+
+	std::vector<long long> program = read_program(argv[1]);
+
+	if (program.empty()) {
+		std::cerr << "no program in " << argv[1] << '\n';
+		exit(1);
+	}
+
+	ControlFlowGraph cfg(std::move(program));
+
+	const auto &code = cfg.instructions();
+	const auto &blocks = cfg.blocks();
+
+	bool profiled = argc == 3;
+
+	std::vector<long long> entries(blocks.size(), 0);
+	std::vector<long long> executed(blocks.size(), 0);
+
+	if (profiled) {
+		auto hits = read_profile(argv[2]);
+
+		for (const auto &[address, ins] : code) {
+			auto it = hits.find(address);
+
+			if (it == hits.end()) {
+				continue;
+			}
+
+			executed[ins.block] += it->second;
+
+			if (blocks[ins.block].start == address) {
+				entries[ins.block] = it->second;
+			}
+		}
+	}
+
+	std::cout << "{\n"
+	          << "  \"program\": ";
+
+	write_string(std::cout, argv[1]);
+
+	std::cout << ",\n"
+	          << "  \"size\": " << cfg.program().size() << ",\n"
+	          << "  \"instructions\": " << code.size() << ",\n"
+	          << "  \"blocks\": [";
+
+	for (std::size_t b = 0; b < blocks.size(); ++b) {
+		const CodeBlock &block = blocks[b];
+
+		std::cout << (b ? ",\n" : "\n")
+		          << "    {\"id\": " << b << ", \"start\": " << block.start << ", \"end\": " << block.end
+		          << ", \"successors\": ";
+
+		write_list(std::cout, block.successors);
+
+		std::cout << ", \"indirect\": " << (block.indirect ? "true" : "false")
+		          << ", \"call\": " << (block.call ? "true" : "false")
+		          << ", \"return\": " << (block.ret ? "true" : "false");
+
+		if (profiled) {
+			std::cout << ", \"entries\": " << entries[b] << ", \"executed\": " << executed[b];
+		}
+
+		std::cout << '}';
+	}
+
+	std::cout << "\n  ],\n  \"functions\": [";
+
+	const auto &functions = cfg.functions();
+
+	for (std::size_t f = 0; f < functions.size(); ++f) {
+		const CodeFunction &fn = functions[f];
+
+		std::cout << (f ? ",\n" : "\n")
+		          << "    {\"entry\": " << fn.entry << ", \"frame\": " << fn.frame << ", \"callers\": ";
+		write_list(std::cout, fn.callers);
+		std::cout << ", \"returns\": ";
+		write_list(std::cout, fn.returns);
+		std::cout << ", \"blocks\": ";
+		write_list(std::cout, fn.blocks);
+		std::cout << '}';
+	}
+
+	std::cout << "\n  ],\n  \"self_modifying\": [";
+
+	const auto &writes = cfg.self_writes();
+
+	for (std::size_t i = 0; i < writes.size(); ++i) {
+		std::cout << (i ? ",\n" : "\n")
+		          << "    {\"pc\": " << writes[i].pc << ", \"address\": " << writes[i].address << '}';
+	}
+
+	std::cout << "\n  ]\n}\n";
+
+	if (profiled) {
+		long long total = 0;
+
+		std::vector<std::size_t> order(blocks.size());
+
+		for (std::size_t b = 0; b < blocks.size(); ++b) {
+			order[b] = b;
+			total += executed[b];
+		}
+
+		std::stable_sort(order.begin(), order.end(), [&](std::size_t lhs, std::size_t rhs) {
+			return executed[lhs] > executed[rhs];
+		});
+
+		std::cerr << " block     start       end     entries    executed   share\n";
+
+		for (std::size_t i = 0; i < std::min<std::size_t>(order.size(), 20); ++i) {
+			std::size_t b = order[i];
+
+			if (executed[b] == 0) {
+				break;
+			}
+
+			std::cerr << std::setw(6) << b << std::setw(10) << blocks[b].start
+			          << std::setw(10) << blocks[b].end << std::setw(12) << entries[b]
+			          << std::setw(12) << executed[b] << std::setw(7) << std::fixed << std::setprecision(1)
+			          << 100.0 * static_cast<double>(executed[b]) / static_cast<double>(std::max(total, 1LL)) << "%\n";
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,183 @@
+//
+// ASCII line IODevice for the Intcode computer
+//
+
+// AsciiIO is for programs that talk in lines of ASCII text, like days 17,
+// 21 and 25. The host queues input a line at a time with push_line(), and
+// the program pauses when it wants input and there is none, so the host
+// can run it until it has read a whole command and answered it.
+//
+// Output is kept as values, and only split into lines when the host asks
+// for one with pull_line(), which resumes looking for the end of the line
+// where the last call left off. Values outside ASCII, like the answers days
+// 17 and 21 end with, are read with pull_value(). write_output() writes all
+// pending output the way the days print it.
+//
+// Input and output are kept in ring buffers that grow as needed, so a long
+// running program that is drained regularly allocates nothing after the
+// first lines.
+
+#ifndef AOC_INTCODE_ASCII_H_INCLUDED
+#define AOC_INTCODE_ASCII_H_INCLUDED
+
+#include <cctype>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Queue of values in a power of two sized buffer
+class RingBuffer {
+public:
+	bool empty() const { return count == 0; }
+	std::size_t size() const { return count; }
+
+	long long front() const { return buffer[head]; }
+
+	// Value i places from the front
+	long long operator[](std::size_t i) const { return buffer[(head + i) & (buffer.size() - 1)]; }
+
+	void push_back(long long value) {
+		if (count == buffer.size()) {
+			grow();
+		}
+
+		buffer[(head + count) & (buffer.size() - 1)] = value;
+		++count;
+	}
+
+	void pop_front(std::size_t n = 1) {
+		head = (head + n) & (buffer.size() - 1);
+		count -= n;
+	}
+
+	void clear() {
+		head = 0;
+		count = 0;
+	}
+
+private:
+	std::vector<long long> buffer;
+	std::size_t head = 0;
+	std::size_t count = 0;
+
+	void grow() {
+		std::vector<long long> new_buffer(buffer.empty() ? 256 : 2 * buffer.size());
+
+		for (std::size_t i = 0; i < count; ++i) {
+			new_buffer[i] = (*this)[i];
+		}
+
+		buffer.swap(new_buffer);
+		head = 0;
+	}
+};
+
+class AsciiIO {
+public:
+	// Queue text as input
+	void push_text(std::string_view text) {
+		for (char ch : text) {
+			input.push_back(static_cast<unsigned char>(ch));
+		}
+	}
+
+	// Queue line as input, followed by a newline
+	void push_line(std::string_view line) {
+		push_text(line);
+		input.push_back('\n');
+	}
+
+	bool input_empty() const { return input.empty(); }
+
+	// Get the next line of output without the newline. Returns false if
+	// there is no complete line, or a value outside ASCII comes first.
+	bool pull_line(std::string &line) {
+		for (; scanned < output.size(); ++scanned) {
+			long long value = output[scanned];
+
+			if (value < 0 || value > 127) {
+				return false;
+			}
+
+			if (value == '\n') {
+				line.clear();
+
+				for (std::size_t i = 0; i < scanned; ++i) {
+					line.push_back(static_cast<char>(output[i]));
+				}
+
+				output.pop_front(scanned + 1);
+				scanned = 0;
+
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	// Get the next value of output, returns false if there is none
+	bool pull_value(long long &value) {
+		if (output.empty()) {
+			return false;
+		}
+
+		value = output.front();
+		output.pop_front();
+		scanned = 0;
+
+		return true;
+	}
+
+	bool output_empty() const { return output.empty(); }
+
+	// Write all pending output to os, printable characters as they are and
+	// other values as numbers on a line of their own
+	void write_output(std::ostream &os) {
+		std::string text;
+
+		for (std::size_t i = 0; i < output.size(); ++i) {
+			long long value = output[i];
+
+			if (value == 10 || (value < 256 && std::isprint(static_cast<unsigned char>(value)))) {
+				text.push_back(static_cast<char>(value));
+			}
+			else {
+				text += std::to_string(value);
+				text.push_back('\n');
+			}
+		}
+
+		os << text;
+
+		output.clear();
+		scanned = 0;
+	}
+
+	bool operator>>(long long &rhs) {
+		if (input.empty()) {
+			return false;
+		}
+
+		rhs = input.front();
+		input.pop_front();
+
+		return true;
+	}
+
+	bool operator<<(long long rhs) {
+		output.push_back(rhs);
+		return true;
+	}
+
+private:
+	RingBuffer input;
+	RingBuffer output;
+
+	// Number of values at the front of output known to contain no newline
+	std::size_t scanned = 0;
+};
+
+#endif // AOC_INTCODE_ASCII_H_INCLUDED
@@ -0,0 +1,348 @@
+//
+// Lockstep execution of a batch of Intcode computers
+//
+
+// BatchComputer<N> runs N copies of the same program with their own
+// memory, registers and io. Memory is stored interleaved, with word
+// address of lane l at index address * N + l, so one instruction loads
+// and stores all lanes at adjacent addresses, and the per-lane loops can
+// be vectorized by the compiler.
+//
+// Each step executes the instruction at the lowest pc of any running
+// lane, for the lanes at that pc with the same instruction word, and the
+// others wait. Lanes that branch apart run on their own until they reach
+// the same pc again, which for programs like day 2 and day 19 is all the
+// way to the end.
+//
+// Lanes read input from a queue, and a lane that runs out of input waits
+// until more is added. Output is collected per lane.
+
+#ifndef AOC_INTCODE_BATCH_H_INCLUDED
+#define AOC_INTCODE_BATCH_H_INCLUDED
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+template<std::size_t N>
+class BatchComputer {
+	enum class State : char { running, waiting, halted };
+
+	std::vector<long long> memory;
+	std::size_t size = 0;
+	std::array<long long, N> pc{};
+	std::array<long long, N> base{};
+	std::array<State, N> state{};
+	std::array<std::vector<long long>, N> inputs;
+	std::array<std::size_t, N> input_pos{};
+	std::array<std::vector<long long>, N> outputs;
+
+	void grow(std::size_t new_size) {
+		if (new_size > size) {
+			size = new_size;
+			memory.resize(size * N);
+		}
+	}
+
+	static void address_error(long long address) {
+		std::cerr << "address error: " << address << std::endl;
+		exit(1);
+	}
+
+	long long read(long long address, std::size_t lane) const {
+		if (static_cast<std::size_t>(address) >= size) {
+			if (address < 0) {
+				address_error(address);
+			}
+
+			return 0;
+		}
+
+		return memory[address * N + lane];
+	}
+
+	long long &at(long long address, std::size_t lane) {
+		if (address < 0) {
+			address_error(address);
+		}
+
+		grow(static_cast<std::size_t>(address) + 1);
+
+		return memory[address * N + lane];
+	}
+
+	// Get operands at address pc with mode for all lanes. The loops have
+	// no branches on the lane, so lanes not in mask get values that are
+	// ignored, and addresses outside memory read as 0.
+	void get_args(std::array<long long, N> &res, long long pc, int mode, const std::array<bool, N> &mask) const {
+		const long long *args = &memory[pc * N];
+
+		if (mode == 1) {
+			for (std::size_t l = 0; l < N; ++l) {
+				res[l] = args[l];
+			}
+
+			return;
+		}
+
+		bool bad = false;
+
+		for (std::size_t l = 0; l < N; ++l) {
+			long long address = mode == 2 ? base[l] + args[l] : args[l];
+
+			bad |= mask[l] & (address < 0);
+
+			res[l] = static_cast<std::size_t>(address) < size ? memory[address * N + l] : 0;
+		}
+
+		if (bad) {
+			for (std::size_t l = 0; l < N; ++l) {
+				long long address = mode == 2 ? base[l] + args[l] : args[l];
+
+				if (mask[l] && address < 0) {
+					address_error(address);
+				}
+			}
+		}
+	}
+
+	void set_args(long long pc, int mode, const std::array<long long, N> &values, const std::array<bool, N> &mask) {
+		std::array<long long, N> addresses;
+		long long max_address = 0;
+
+		for (std::size_t l = 0; l < N; ++l) {
+			long long address = memory[pc * N + l];
+
+			addresses[l] = mode == 2 ? base[l] + address : address;
+
+			if (mask[l]) {
+				if (addresses[l] < 0) {
+					address_error(addresses[l]);
+				}
+
+				max_address = std::max(max_address, addresses[l]);
+			}
+		}
+
+		grow(static_cast<std::size_t>(max_address) + 1);
+
+		for (std::size_t l = 0; l < N; ++l) {
+			if (mask[l]) {
+				memory[addresses[l] * N + l] = values[l];
+			}
+		}
+	}
+
+	void step(long long cur, long long word, const std::array<bool, N> &mask);
+
+public:
+	explicit BatchComputer(const std::vector<long long> &program) { reset(program); }
+
+	// Start over with program in every lane, reusing the memory already
+	// allocated
+	void reset(const std::vector<long long> &program) {
+		size = program.size();
+		memory.resize(size * N);
+
+		for (std::size_t i = 0; i < size; ++i) {
+			for (std::size_t l = 0; l < N; ++l) {
+				memory[i * N + l] = program[i];
+			}
+		}
+
+		pc.fill(0);
+		base.fill(0);
+		state.fill(State::running);
+		input_pos.fill(0);
+
+		for (std::size_t l = 0; l < N; ++l) {
+			inputs[l].clear();
+			outputs[l].clear();
+		}
+	}
+
+	static constexpr std::size_t lanes() { return N; }
+
+	bool halted(std::size_t lane) const { return state[lane] == State::halted; }
+
+	long long peek(std::size_t lane, long long address) const { return read(address, lane); }
+	void poke(std::size_t lane, long long address, long long value) { at(address, lane) = value; }
+
+	void add_input(std::size_t lane, long long value) {
+		inputs[lane].push_back(value);
+
+		if (state[lane] == State::waiting) {
+			state[lane] = State::running;
+		}
+	}
+
+	const std::vector<long long> &output(std::size_t lane) const { return outputs[lane]; }
+
+	// Run until every lane is halted or waiting for input
+	void run();
+};
+
+template<std::size_t N>
+void BatchComputer<N>::run()
+{
+	for (;;) {
+		long long cur = std::numeric_limits<long long>::max();
+
+		for (std::size_t l = 0; l < N; ++l) {
+			if (state[l] == State::running && pc[l] < cur) {
+				cur = pc[l];
+			}
+		}
+
+		if (cur == std::numeric_limits<long long>::max()) {
+			return;
+		}
+
+		std::array<bool, N> mask{};
+		long long word = 0;
+		bool first = true;
+
+		for (std::size_t l = 0; l < N; ++l) {
+			if (state[l] != State::running || pc[l] != cur) {
+				continue;
+			}
+
+			if (first) {
+				word = read(cur, l);
+				first = false;
+			}
+
+			mask[l] = read(cur, l) == word;
+		}
+
+		step(cur, word, mask);
+	}
+}
+
+template<std::size_t N>
+void BatchComputer<N>::step(long long cur, long long word, const std::array<bool, N> &mask)
+{
+	// Make sure the operands of the instruction are in memory
+	grow(static_cast<std::size_t>(cur) + 4);
+
+	int opcode = static_cast<int>(word % 100);
+	int pmode1 = static_cast<int>((word / 100) % 10);
+	int pmode2 = static_cast<int>((word / 1000) % 10);
+	int pmode3 = static_cast<int>((word / 10000) % 10);
+
+	if (word < 0 || pmode1 > 2 || pmode2 > 2 || pmode3 > 2) {
+		opcode = 0;
+	}
+
+	std::array<long long, N> op1, op2, res;
+
+	switch (opcode) {
+	case 1:
+	case 2:
+	case 7:
+	case 8:
+		get_args(op1, cur + 1, pmode1, mask);
+		get_args(op2, cur + 2, pmode2, mask);
+
+		switch (opcode) {
+		case 1:
+			for (std::size_t l = 0; l < N; ++l) {
+				res[l] = op1[l] + op2[l];
+			}
+			break;
+		case 2:
+			for (std::size_t l = 0; l < N; ++l) {
+				res[l] = op1[l] * op2[l];
+			}
+			break;
+		case 7:
+			for (std::size_t l = 0; l < N; ++l) {
+				res[l] = op1[l] < op2[l];
+			}
+			break;
+		default:
+			for (std::size_t l = 0; l < N; ++l) {
+				res[l] = op1[l] == op2[l];
+			}
+			break;
+		}
+
+		set_args(cur + 3, pmode3, res, mask);
+
+		for (std::size_t l = 0; l < N; ++l) {
+			pc[l] += mask[l] ? 4 : 0;
+		}
+		break;
+	case 3: {
+		std::array<bool, N> ready{};
+
+		for (std::size_t l = 0; l < N; ++l) {
+			res[l] = 0;
+
+			if (!mask[l]) {
+				continue;
+			}
+
+			if (input_pos[l] < inputs[l].size()) {
+				res[l] = inputs[l][input_pos[l]++];
+				ready[l] = true;
+			}
+			else {
+				state[l] = State::waiting;
+			}
+		}
+
+		set_args(cur + 1, pmode1, res, ready);
+
+		for (std::size_t l = 0; l < N; ++l) {
+			pc[l] += ready[l] ? 2 : 0;
+		}
+		break;
+	}
+	case 4:
+		get_args(op1, cur + 1, pmode1, mask);
+
+		for (std::size_t l = 0; l < N; ++l) {
+			if (mask[l]) {
+				outputs[l].push_back(op1[l]);
+				pc[l] += 2;
+			}
+		}
+		break;
+	case 5:
+	case 6:
+		get_args(op1, cur + 1, pmode1, mask);
+		get_args(op2, cur + 2, pmode2, mask);
+
+		for (std::size_t l = 0; l < N; ++l) {
+			if (mask[l]) {
+				pc[l] = (op1[l] != 0) == (opcode == 5) ? op2[l] : pc[l] + 3;
+			}
+		}
+		break;
+	case 9:
+		get_args(op1, cur + 1, pmode1, mask);
+
+		for (std::size_t l = 0; l < N; ++l) {
+			base[l] += mask[l] ? op1[l] : 0;
+			pc[l] += mask[l] ? 2 : 0;
+		}
+		break;
+	case 99:
+		for (std::size_t l = 0; l < N; ++l) {
+			if (mask[l]) {
+				state[l] = State::halted;
+			}
+		}
+		break;
+	default:
+		std::cerr << "opcode error: " << word << std::endl;
+		exit(1);
+	}
+}
+
+#endif // AOC_INTCODE_BATCH_H_INCLUDED
@@ -0,0 +1,179 @@
+//
+// Benchmark the Intcode engines on the programs in the tree
+//
+
+// Usage: bench [ROOT] [SECONDS]
+//
+// Runs the Intcode program of each day found under ROOT (default .), with
+// scripted input that drives it through a typical run, on every engine,
+// and prints instructions per second, nanoseconds per instruction, and
+// heap allocations and peak heap use per run.
+//
+// The engines are the reference interpreter in reference.h, which also
+// counts the instructions, Computer stepped one decoded instruction at a
+// time, and Computer::run() with switch dispatch, threaded dispatch and
+// the JIT. Each is compiled in its own file with the flags selecting it,
+// see bench.h, so build this together with bench_switch.cpp,
+// bench_threaded.cpp and bench_jit.cpp. Each engine runs a program
+// repeatedly for about SECONDS (default 0.5), and the fastest run is
+// reported. The outputs of each engine are checked against the reference.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "image.h"
+#include "reference.h"
+
+// The replacement operator new and delete below keep the size of each
+// allocation in front of it
+namespace heap {
+	constexpr std::size_t header = alignof(std::max_align_t);
+
+	std::size_t allocations = 0;
+	std::size_t live = 0;
+	std::size_t peak = 0;
+
+	void reset()
+	{
+		allocations = 0;
+		peak = live;
+	}
+}
+
+void *operator new(std::size_t size)
+{
+	char *p = static_cast<char *>(std::malloc(size + heap::header));
+
+	if (!p) {
+		throw std::bad_alloc();
+	}
+
+	*reinterpret_cast<std::size_t *>(p) = size;
+
+	++heap::allocations;
+	heap::live += size;
+	heap::peak = std::max(heap::peak, heap::live);
+
+	return p + heap::header;
+}
+
+void operator delete(void *ptr) noexcept
+{
+	if (ptr) {
+		char *p = static_cast<char *>(ptr) - heap::header;
+
+		heap::live -= *reinterpret_cast<std::size_t *>(p);
+
+		std::free(p);
+	}
+}
+
+void *operator new[](std::size_t size) { return operator new(size); }
+void operator delete[](void *ptr) noexcept { operator delete(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { operator delete(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { operator delete(ptr); }
+
+std::vector<long long> ascii(const std::string &text)
+{
+	return std::vector<long long>(text.begin(), text.end());
+}
+
+std::vector<Workload> make_workloads()
+{
+	std::vector<Workload> res;
+
+	// Part two of each day where the input can be scripted up front
+	res.push_back({"02", {{1, 12}, {2, 2}}, {}, Then::stop, 0});
+	res.push_back({"05", {}, {5}, Then::stop, 0});
+	res.push_back({"07", {}, {5, 0}, Then::echo, 0});
+	res.push_back({"09", {}, {2}, Then::stop, 0});
+	res.push_back({"11", {}, {1}, Then::hold, 0});
+	res.push_back({"13", {{0, 2}}, {0}, Then::hold, 0});
+	res.push_back({"15", {}, {1, 4, 2, 3}, Then::cycle, 20000});
+	res.push_back({"17", {{0, 2}}, ascii("C,B,C,A,C,B,A,C,B,A\n"
+	                                     "R,12,R,4,L,12,L,12\n"
+	                                     "R,4,R,8,R,10,R,12\n"
+	                                     "R,8,R,10,R,10\n"
+	                                     "n\n"), Then::stop, 0});
+	res.push_back({"19", {}, {20, 30}, Then::stop, 0});
+	res.push_back({"21", {}, ascii("NOT H T\nOR C T\nAND B T\nAND A T\nNOT T J\nAND D J\nRUN\n"),
+	               Then::stop, 0});
+
+	// A network node that only ever sees empty queues
+	Workload nic{"23", {}, {0}, Then::stop, 0};
+	nic.script.resize(2000, -1);
+	res.push_back(nic);
+
+	res.push_back({"25", {}, ascii("south\ntake whirled peas\nnorth\nwest\nsouth\ninv\n"), Then::stop, 0});
+
+	return res;
+}
+
+void report(const std::string &day, const char *engine, const Result &res, long long instructions)
+{
+	std::cout << std::setw(4) << day << "  " << std::left << std::setw(10) << engine << std::right
+	          << std::setw(12) << instructions
+	          << std::setw(12) << std::fixed << std::setprecision(1) << instructions / res.seconds / 1e6
+	          << std::setw(10) << std::setprecision(2) << res.seconds * 1e9 / instructions
+	          << std::setw(10) << res.allocations
+	          << std::setw(10) << (res.peak_bytes + 1023) / 1024 << '\n';
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc > 3) {
+		std::cerr << "usage: bench [ROOT] [SECONDS]\n";
+		exit(1);
+	}
+
+	std::string root = argc > 1 ? argv[1] : ".";
+	double seconds = argc > 2 ? std::stod(argv[2]) : 0.5;
+
+	std::cout << " day  engine    instructions   Minstr/s  ns/instr    allocs  peak KiB\n";
+
+	bool mismatch = false;
+
+	for (const Workload &work : make_workloads()) {
+		std::string filename = root + "/2019" + work.day + "/input" + work.day + ".txt";
+
+		if (!std::ifstream(filename)) {
+			continue;
+		}
+
+		std::vector<long long> program = ProgramImage(filename.c_str()).to_vector();
+
+		long long instructions = 0;
+
+		Result ref = measure<ReferenceComputer<ScriptIO>>(program, work, seconds,
+			[&](auto &c) { c.run(); instructions = c.instructions(); });
+
+		report(work.day, "reference", ref, instructions);
+
+		auto check = [&](const char *engine, const Result &res) {
+			report(work.day, engine, res, instructions);
+
+			if (res.outputs != ref.outputs || res.checksum != ref.checksum) {
+				std::cout << "      output differs from reference: " << res.outputs << " outputs\n";
+				mismatch = true;
+			}
+		};
+
+		check("decoded", bench_decoded(program, work, seconds));
+		check("switch", bench_switch(program, work, seconds));
+		check("threaded", bench_threaded(program, work, seconds));
+
+		if (bench_jit_available) {
+			check("jit", bench_jit(program, work, seconds));
+		}
+	}
+
+	return mismatch ? 1 : 0;
+}
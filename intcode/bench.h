@@ -0,0 +1,163 @@
+//
+// Workloads and measurement shared by the engines of the Intcode benchmark
+//
+
+// bench.cpp drives the engines, which are each compiled in their own file
+// with the flags that select them, bench_switch.cpp, bench_threaded.cpp
+// and bench_jit.cpp, so one binary can compare them all. Each engine file
+// runs the Computer with its own IODevice derived from ScriptIO, declared
+// in an unnamed namespace, which makes the Computer of each engine a
+// different class even though the flags change its definition.
+
+#ifndef AOC_INTCODE_BENCH_H_INCLUDED
+#define AOC_INTCODE_BENCH_H_INCLUDED
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Heap use, counted by the replacement operator new and delete in
+// bench.cpp
+namespace heap {
+	extern std::size_t allocations;
+	extern std::size_t live;
+	extern std::size_t peak;
+
+	void reset();
+}
+
+// What to give a program when its script runs out
+enum class Then {
+	stop,   // pause the computer, ending the run
+	hold,   // repeat the last value of the script
+	cycle,  // start the script over
+	echo    // feed back the last output, like an amplifier loop
+};
+
+struct Workload {
+	std::string day;
+	std::vector<std::pair<long long, long long>> pokes;
+	std::vector<long long> script;
+	Then then = Then::stop;
+	long long max_outputs = 0;
+};
+
+// IODevice that feeds a program its script and keeps a checksum of the
+// outputs, so the engines can be checked against each other
+struct ScriptIO {
+	const Workload *work = nullptr;
+	std::size_t pos = 0;
+	long long last = 0;
+	long long outputs = 0;
+	std::uint64_t checksum = 0;
+
+	explicit ScriptIO(const Workload *work) : work(work) {}
+
+	bool operator>>(long long &rhs)
+	{
+		const std::vector<long long> &script = work->script;
+
+		if (pos < script.size()) {
+			rhs = script[pos++];
+			return true;
+		}
+
+		switch (work->then) {
+		case Then::stop:
+			return false;
+		case Then::hold:
+			rhs = script.empty() ? 0 : script.back();
+			break;
+		case Then::cycle:
+			rhs = script[pos++ % script.size()];
+			break;
+		case Then::echo:
+			rhs = last;
+			break;
+		}
+
+		return true;
+	}
+
+	bool operator<<(long long rhs)
+	{
+		last = rhs;
+		checksum = checksum * 1000003 + static_cast<std::uint64_t>(rhs);
+
+		return ++outputs != work->max_outputs;
+	}
+};
+
+struct Result {
+	double seconds = 0;
+	std::size_t allocations = 0;
+	std::size_t peak_bytes = 0;
+	long long outputs = 0;
+	std::uint64_t checksum = 0;
+};
+
+// Run work on a fresh Machine with engine, repeating for about seconds
+template<typename Machine, typename Engine>
+Result measure(const std::vector<long long> &program, const Workload &work, double seconds, Engine engine)
+{
+	Result res;
+
+	auto run_once = [&]() {
+		Machine c(program, &work);
+
+		for (auto [address, value] : work.pokes) {
+			c.poke(address, value);
+		}
+
+		engine(c);
+
+		res.outputs = c.io.outputs;
+		res.checksum = c.io.checksum;
+	};
+
+	heap::reset();
+
+	std::size_t live = heap::live;
+
+	auto start = std::chrono::steady_clock::now();
+
+	run_once();
+
+	std::chrono::duration<double> best = std::chrono::steady_clock::now() - start;
+	std::chrono::duration<double> total = best;
+
+	res.allocations = heap::allocations;
+	res.peak_bytes = heap::peak - live;
+
+	for (int i = 1; i < 3 || total.count() < seconds; ++i) {
+		auto run_start = std::chrono::steady_clock::now();
+
+		run_once();
+
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - run_start;
+
+		best = std::min(best, elapsed);
+		total += elapsed;
+	}
+
+	res.seconds = best.count();
+
+	return res;
+}
+
+// Measure Computer::run(), and Computer::step() for the decoded engine,
+// in the engine files. bench_jit_available is false if the JIT is not
+// supported on this platform, and bench_jit() then measures threaded
+// dispatch.
+Result bench_decoded(const std::vector<long long> &program, const Workload &work, double seconds);
+Result bench_switch(const std::vector<long long> &program, const Workload &work, double seconds);
+Result bench_threaded(const std::vector<long long> &program, const Workload &work, double seconds);
+Result bench_jit(const std::vector<long long> &program, const Workload &work, double seconds);
+
+extern const bool bench_jit_available;
+
+#endif // AOC_INTCODE_BENCH_H_INCLUDED
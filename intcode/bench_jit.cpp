@@ -0,0 +1,23 @@
+//
+// JIT engine of the Intcode benchmark, see bench.h
+//
+
+#define INTCODE_JIT 1
+
+#include <vector>
+
+#include "bench.h"
+#include "intcode.h"
+
+namespace {
+	struct JitIO : ScriptIO {
+		using ScriptIO::ScriptIO;
+	};
+}
+
+extern const bool bench_jit_available = INTCODE_JIT;
+
+Result bench_jit(const std::vector<long long> &program, const Workload &work, double seconds)
+{
+	return measure<Computer<JitIO>>(program, work, seconds, [](auto &c) { c.run(); });
+}
@@ -0,0 +1,21 @@
+//
+// Switch dispatch engine of the Intcode benchmark, see bench.h
+//
+
+#define INTCODE_THREADED 0
+
+#include <vector>
+
+#include "bench.h"
+#include "intcode.h"
+
+namespace {
+	struct SwitchIO : ScriptIO {
+		using ScriptIO::ScriptIO;
+	};
+}
+
+Result bench_switch(const std::vector<long long> &program, const Workload &work, double seconds)
+{
+	return measure<Computer<SwitchIO>>(program, work, seconds, [](auto &c) { c.run(); });
+}
@@ -0,0 +1,27 @@
+//
+// Threaded dispatch engine of the Intcode benchmark, see bench.h
+//
+
+#define INTCODE_JIT 0
+
+#include <vector>
+
+#include "bench.h"
+#include "intcode.h"
+
+namespace {
+	struct ThreadedIO : ScriptIO {
+		using ScriptIO::ScriptIO;
+	};
+}
+
+// The decoded instructions, executed one at a time with step()
+Result bench_decoded(const std::vector<long long> &program, const Workload &work, double seconds)
+{
+	return measure<Computer<ThreadedIO>>(program, work, seconds, [](auto &c) { while (c.step()) {} });
+}
+
+Result bench_threaded(const std::vector<long long> &program, const Workload &work, double seconds)
+{
+	return measure<Computer<ThreadedIO>>(program, work, seconds, [](auto &c) { c.run(); });
+}
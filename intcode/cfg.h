@@ -0,0 +1,409 @@
+//
+// Control flow graph of an Intcode program
+//
+
+// ControlFlowGraph finds the code of a program statically and splits it
+// into basic blocks, for tools that translate or analyze programs.
+//
+// The reachable instructions are found by following fall-through and
+// immediate jump targets from address 0, and the addresses after jumps
+// that the program uses as immediate values, which is how Intcode pushes
+// return addresses. Blocks end at jumps, input, output and halt, and
+// where another block jumps to.
+//
+// Functions are recognized by the calling convention Intcode compilers
+// use. A call stores the return address, the address after the jump, as
+// an immediate value in the same block, and jumps to the function with an
+// immediate jump. The function moves the relative base up with opcode 9
+// to make room for its frame, and returns by moving it back down and
+// jumping through relative memory to the return address.
+//
+// Writes to constant addresses that hold code are listed as self-modifying.
+// Writes through the relative base are not, since their address is not
+// known statically.
+
+#ifndef AOC_INTCODE_CFG_H_INCLUDED
+#define AOC_INTCODE_CFG_H_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+struct CodeInstruction {
+	long long address = 0;
+	int opcode = 0;
+	int mode[3] = { 0, 0, 0 };
+	long long arg[3] = { 0, 0, 0 };
+	int length = 1;
+	bool valid = false;
+	int block = 0;
+
+	long long next() const { return address + length; }
+
+	bool is_jump() const { return valid && (opcode == 5 || opcode == 6); }
+
+	// An immediate condition makes a jump unconditional
+	bool is_unconditional_jump() const {
+		return is_jump() && mode[0] == 1 && (arg[0] != 0) == (opcode == 5);
+	}
+
+	bool falls_through() const { return valid && opcode != 99 && !is_unconditional_jump(); }
+
+	// Index of the argument that is written to, or -1
+	int destination() const {
+		if (!valid) {
+			return -1;
+		}
+
+		return opcode == 3 ? 0 : length == 4 ? 2 : -1;
+	}
+};
+
+struct CodeBlock {
+	long long start = 0;
+	long long end = 0;
+	std::vector<int> successors;
+	bool indirect = false;
+	bool call = false;
+	bool ret = false;
+};
+
+struct CodeFunction {
+	long long entry = 0;
+	long long frame = 0;
+	std::vector<long long> callers;
+	std::vector<long long> returns;
+	std::vector<int> blocks;
+};
+
+// Instruction at pc writes to a constant address that holds code
+struct SelfWrite {
+	long long pc = 0;
+	long long address = 0;
+};
+
+class ControlFlowGraph {
+public:
+	explicit ControlFlowGraph(std::vector<long long> program) : words(std::move(program)) {
+		find_code();
+		find_blocks();
+		find_edges();
+		find_functions();
+		find_self_writes();
+	}
+
+	long long word(long long address) const {
+		if (address < 0 || static_cast<std::size_t>(address) >= words.size()) {
+			return 0;
+		}
+
+		return words[address];
+	}
+
+	const std::vector<long long> &program() const { return words; }
+	const std::map<long long, CodeInstruction> &instructions() const { return code; }
+	const std::vector<CodeBlock> &blocks() const { return block_list; }
+	const std::vector<CodeFunction> &functions() const { return function_list; }
+	const std::vector<SelfWrite> &self_writes() const { return self_write_list; }
+
+	bool is_leader(long long address) const { return leaders.count(address) != 0; }
+
+	// Index of the block starting at address, or -1
+	int block_at(long long address) const {
+		auto it = code.find(address);
+
+		if (it == code.end() || block_list[it->second.block].start != address) {
+			return -1;
+		}
+
+		return it->second.block;
+	}
+
+	CodeInstruction decode(long long address) const;
+
+private:
+	std::vector<long long> words;
+	std::map<long long, CodeInstruction> code;
+	std::set<long long> leaders;
+	std::vector<CodeBlock> block_list;
+	std::vector<CodeFunction> function_list;
+	std::vector<SelfWrite> self_write_list;
+
+	void find_code();
+	void find_blocks();
+	void find_edges();
+	void find_functions();
+	void find_self_writes();
+};
+
+inline CodeInstruction ControlFlowGraph::decode(long long address) const
+{
+	static constexpr int lengths[10] = { 1, 4, 4, 2, 2, 3, 3, 4, 4, 2 };
+
+	CodeInstruction ins;
+
+	long long w = word(address);
+
+	ins.address = address;
+	ins.opcode = static_cast<int>(w % 100);
+	ins.mode[0] = static_cast<int>((w / 100) % 10);
+	ins.mode[1] = static_cast<int>((w / 1000) % 10);
+	ins.mode[2] = static_cast<int>((w / 10000) % 10);
+
+	ins.valid = w >= 0 && w <= 99999
+	         && ins.mode[0] <= 2 && ins.mode[1] <= 2 && ins.mode[2] <= 2
+	         && ((ins.opcode >= 1 && ins.opcode <= 9) || ins.opcode == 99);
+
+	if (ins.valid && ins.opcode != 99) {
+		ins.length = lengths[ins.opcode];
+	}
+
+	for (int i = 0; i < ins.length - 1; ++i) {
+		ins.arg[i] = word(address + 1 + i);
+	}
+
+	return ins;
+}
+
+inline void ControlFlowGraph::find_code()
+{
+	std::vector<long long> work = { 0 };
+	std::set<long long> roots = { 0 };
+
+	for (;;) {
+		while (!work.empty()) {
+			long long address = work.back();
+			work.pop_back();
+
+			if (address < 0 || code.count(address)) {
+				continue;
+			}
+
+			CodeInstruction ins = decode(address);
+
+			code[address] = ins;
+
+			if (!ins.valid || ins.opcode == 99) {
+				continue;
+			}
+
+			long long next = ins.next();
+
+			if (ins.is_jump()) {
+				leaders.insert(next);
+
+				if (ins.mode[1] == 1) {
+					leaders.insert(ins.arg[1]);
+					work.push_back(ins.arg[1]);
+				}
+
+				if (ins.is_unconditional_jump()) {
+					continue;
+				}
+			}
+			else if (ins.opcode == 3 || ins.opcode == 4) {
+				leaders.insert(next);
+			}
+
+			work.push_back(next);
+		}
+
+		// Add immediate values that point just past a jump, since those
+		// are return addresses
+		for (const auto &[address, ins] : code) {
+			if (!ins.valid) {
+				continue;
+			}
+
+			for (int i = 0; i < ins.length - 1; ++i) {
+				long long target = ins.arg[i];
+
+				if (ins.mode[i] != 1 || roots.count(target) || code.count(target)) {
+					continue;
+				}
+
+				auto prev = code.lower_bound(target);
+
+				if (prev == code.begin()) {
+					continue;
+				}
+
+				--prev;
+
+				const CodeInstruction &jump = prev->second;
+
+				if (jump.is_jump() && jump.next() == target) {
+					roots.insert(target);
+					work.push_back(target);
+				}
+			}
+		}
+
+		if (work.empty()) {
+			break;
+		}
+	}
+
+	leaders.insert(roots.begin(), roots.end());
+}
+
+inline void ControlFlowGraph::find_blocks()
+{
+	long long prev_end = -1;
+	bool prev_falls = false;
+
+	for (auto &[address, ins] : code) {
+		if (block_list.empty() || is_leader(address) || address != prev_end || !prev_falls) {
+			leaders.insert(address);
+			block_list.emplace_back();
+			block_list.back().start = address;
+		}
+
+		ins.block = static_cast<int>(block_list.size()) - 1;
+
+		block_list.back().end = ins.next();
+
+		prev_end = ins.next();
+		prev_falls = ins.valid && ins.opcode != 99;
+	}
+}
+
+inline void ControlFlowGraph::find_edges()
+{
+	for (CodeBlock &block : block_list) {
+		auto last_it = code.lower_bound(block.end);
+		const CodeInstruction &last = (--last_it)->second;
+
+		if (last.is_jump()) {
+			if (last.mode[1] == 1) {
+				if (int target = block_at(last.arg[1]); target != -1) {
+					block.successors.push_back(target);
+				}
+			}
+			else {
+				block.indirect = true;
+			}
+
+			if (last.is_unconditional_jump()) {
+				// The return address of a call is stored in the block
+				// that makes it
+				bool stores_return = false;
+
+				for (auto it = code.find(block.start); it != code.end() && it->first < last.address; ++it) {
+					const CodeInstruction &ins = it->second;
+
+					for (int i = 0; i < ins.length - 1; ++i) {
+						if (ins.valid && ins.mode[i] == 1 && ins.arg[i] == last.next()) {
+							stores_return = true;
+						}
+					}
+				}
+
+				block.call = stores_return && last.mode[1] == 1;
+				block.ret = last.mode[1] == 2;
+			}
+		}
+
+		if (last.falls_through()) {
+			if (int next = block_at(last.next()); next != -1) {
+				block.successors.push_back(next);
+			}
+		}
+	}
+}
+
+inline void ControlFlowGraph::find_functions()
+{
+	std::map<long long, CodeFunction> entries;
+
+	for (const CodeBlock &block : block_list) {
+		if (!block.call || block.successors.empty()) {
+			continue;
+		}
+
+		auto last_it = code.lower_bound(block.end);
+		const CodeInstruction &last = (--last_it)->second;
+
+		CodeFunction &fn = entries[last.arg[1]];
+
+		fn.entry = last.arg[1];
+		fn.callers.push_back(last.address);
+	}
+
+	for (auto &[entry, fn] : entries) {
+		// The frame is the first relative base adjustment in the entry
+		// block
+		int first = block_at(entry);
+
+		for (auto it = code.find(entry); it != code.end() && it->first < block_list[first].end; ++it) {
+			const CodeInstruction &ins = it->second;
+
+			if (ins.valid && ins.opcode == 9 && ins.mode[0] == 1) {
+				fn.frame = ins.arg[0];
+				break;
+			}
+		}
+
+		// Follow the blocks of the function, stepping over calls to the
+		// return address
+		std::vector<int> work = { first };
+		std::set<int> seen = { first };
+
+		while (!work.empty()) {
+			int b = work.back();
+			work.pop_back();
+
+			const CodeBlock &block = block_list[b];
+
+			fn.blocks.push_back(b);
+
+			auto last_it = code.lower_bound(block.end);
+			const CodeInstruction &last = (--last_it)->second;
+
+			if (block.ret) {
+				fn.returns.push_back(last.address);
+			}
+
+			std::vector<int> next = block.successors;
+
+			if (block.call) {
+				next.assign(1, block_at(last.next()));
+			}
+
+			for (int n : next) {
+				if (n != -1 && seen.insert(n).second) {
+					work.push_back(n);
+				}
+			}
+		}
+
+		std::sort(fn.blocks.begin(), fn.blocks.end());
+		std::sort(fn.returns.begin(), fn.returns.end());
+
+		function_list.push_back(std::move(fn));
+	}
+}
+
+inline void ControlFlowGraph::find_self_writes()
+{
+	std::set<long long> code_words;
+
+	for (const auto &[address, ins] : code) {
+		for (long long a = address; a < ins.next(); ++a) {
+			code_words.insert(a);
+		}
+	}
+
+	for (const auto &[address, ins] : code) {
+		int dst = ins.destination();
+
+		if (dst != -1 && ins.mode[dst] != 2 && code_words.count(ins.arg[dst])) {
+			self_write_list.push_back({address, ins.arg[dst]});
+		}
+	}
+}
+
+#endif // AOC_INTCODE_CFG_H_INCLUDED
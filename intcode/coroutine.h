@@ -0,0 +1,176 @@
+//
+// Coroutine IODevice for the Intcode computer
+//
+
+// CoroutineIO runs host logic written as a C++20 coroutine returning
+// IOTask alongside the computer, so the host can be straight-line code
+// instead of a state machine that is called for each value.
+//
+// The coroutine sends input to the program with co_yield, and receives
+// the next output with co_await next_output, which gives std::nullopt
+// once the program has halted. The coroutine is only resumed when the
+// program needs input, so outputs are queued until then. co_await
+// has_output tells if there is an output queued without waiting for one,
+// so false means the program has asked for input, or halted, after the
+// outputs read so far.
+//
+// After run() returns with the program halted, call finish() to let the
+// coroutine handle the last outputs. If run() returns without halting,
+// the coroutine is waiting for output while the program is waiting for
+// input.
+//
+// Requires C++20.
+
+#ifndef AOC_INTCODE_COROUTINE_H_INCLUDED
+#define AOC_INTCODE_COROUTINE_H_INCLUDED
+
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <optional>
+#include <utility>
+
+// Tag to co_await for the next output of the program
+struct NextOutput {};
+
+inline constexpr NextOutput next_output{};
+
+// Tag to co_await for whether an output is queued
+struct HasOutput {};
+
+inline constexpr HasOutput has_output{};
+
+class IOTask {
+public:
+	struct promise_type {
+		std::optional<long long> input;
+		std::deque<long long> outputs;
+		bool awaiting = false;
+		bool halted = false;
+
+		struct OutputAwaiter {
+			promise_type &p;
+
+			bool await_ready() const noexcept { return !p.outputs.empty() || p.halted; }
+
+			void await_suspend(std::coroutine_handle<>) noexcept { p.awaiting = true; }
+
+			std::optional<long long> await_resume() noexcept
+			{
+				p.awaiting = false;
+
+				if (p.outputs.empty()) {
+					return std::nullopt;
+				}
+
+				long long value = p.outputs.front();
+				p.outputs.pop_front();
+
+				return value;
+			}
+		};
+
+		IOTask get_return_object() { return IOTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+
+		std::suspend_always yield_value(long long value)
+		{
+			input = value;
+			return {};
+		}
+
+		struct QueuedAwaiter {
+			promise_type &p;
+
+			bool await_ready() const noexcept { return true; }
+			void await_suspend(std::coroutine_handle<>) noexcept {}
+			bool await_resume() const noexcept { return !p.outputs.empty(); }
+		};
+
+		OutputAwaiter await_transform(NextOutput) { return {*this}; }
+		QueuedAwaiter await_transform(HasOutput) { return {*this}; }
+
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+	};
+
+	IOTask(IOTask &&other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+
+	IOTask &operator=(IOTask &&other) noexcept
+	{
+		if (this != &other) {
+			destroy();
+			handle = std::exchange(other.handle, nullptr);
+		}
+		return *this;
+	}
+
+	~IOTask() { destroy(); }
+
+	bool done() const { return handle.done(); }
+	void resume() { handle.resume(); }
+	promise_type &promise() { return handle.promise(); }
+
+private:
+	std::coroutine_handle<promise_type> handle;
+
+	explicit IOTask(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+	void destroy()
+	{
+		if (handle) {
+			handle.destroy();
+		}
+	}
+};
+
+// IODevice that passes input and output to and from an IOTask
+struct CoroutineIO {
+	IOTask task;
+
+	explicit CoroutineIO(IOTask task) : task(std::move(task)) {}
+
+	// Resume the coroutine until it yields input, returns false if it
+	// finished or is waiting for output there is none of
+	bool operator>>(long long &rhs)
+	{
+		IOTask::promise_type &p = task.promise();
+
+		for (;;) {
+			if (p.input) {
+				rhs = *p.input;
+				p.input.reset();
+				return true;
+			}
+
+			if (task.done() || (p.awaiting && p.outputs.empty())) {
+				return false;
+			}
+
+			task.resume();
+		}
+	}
+
+	bool operator<<(long long rhs)
+	{
+		task.promise().outputs.push_back(rhs);
+		return true;
+	}
+
+	// Let the coroutine run after the program halted, until it finishes
+	// or yields input that will not be read
+	void finish()
+	{
+		IOTask::promise_type &p = task.promise();
+
+		p.halted = true;
+
+		while (!task.done() && !p.input) {
+			task.resume();
+		}
+	}
+};
+
+#endif // AOC_INTCODE_COROUTINE_H_INCLUDED
@@ -0,0 +1,37 @@
+//
+// Convert an Intcode program to a binary image
+//
+
+// Usage: image PROGRAM IMAGE
+//
+// Writes the program in the text file PROGRAM to IMAGE in the binary
+// format described in image.h, which read_program() and ProgramImage load
+// without parsing.
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "intcode.h"
+
+int main(int argc, char *argv[])
+{
+	if (argc != 3) {
+		std::cerr << "usage: image PROGRAM IMAGE\n";
+		exit(1);
+	}
+
+	std::vector<long long> program = read_program(argv[1]);
+
+	if (program.empty()) {
+		std::cerr << "no program in " << argv[1] << '\n';
+		exit(1);
+	}
+
+	if (!write_program_image(argv[2], program)) {
+		std::cerr << "unable to write " << argv[2] << '\n';
+		exit(1);
+	}
+
+	return 0;
+}
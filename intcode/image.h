@@ -0,0 +1,248 @@
+//
+// Loading Intcode programs from files
+//
+
+// Programs are stored either as text, comma separated like the puzzle
+// input, or as binary images. A binary image (.icb) is the magic "ICB1",
+// four zero bytes, the number of words as a 64-bit little-endian integer,
+// and the words as 64-bit little-endian integers.
+//
+// Files are mapped into memory where mmap is available. Text is parsed
+// straight from the mapping into a vector sized by counting the commas,
+// and the words of a binary image are used from the mapping as they are,
+// so a ProgramImage of a binary image can be the initial memory of a
+// computer without any copying until it is written to.
+
+#ifndef AOC_INTCODE_IMAGE_H_INCLUDED
+#define AOC_INTCODE_IMAGE_H_INCLUDED
+
+#if defined(__unix__) || defined(__APPLE__)
+#  define INTCODE_MMAP 1
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#else
+#  define INTCODE_MMAP 0
+#endif
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Parse comma separated integers from first to last, stopping at the first
+// thing that is not a number or a comma between numbers
+inline std::vector<long long> parse_program(const char *first, const char *last)
+{
+	std::vector<long long> program;
+
+	program.reserve(static_cast<std::size_t>(std::count(first, last, ',')) + 1);
+
+	const char *p = first;
+
+	for (;;) {
+		while (p != last && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+			++p;
+		}
+
+		bool negative = p != last && *p == '-';
+
+		if (negative || (p != last && *p == '+')) {
+			++p;
+		}
+
+		if (p == last || *p < '0' || *p > '9') {
+			break;
+		}
+
+		unsigned long long value = 0;
+
+		while (p != last && *p >= '0' && *p <= '9') {
+			value = value * 10 + static_cast<unsigned long long>(*p++ - '0');
+		}
+
+		program.push_back(negative ? -static_cast<long long>(value) : static_cast<long long>(value));
+
+		while (p != last && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+			++p;
+		}
+
+		if (p == last || *p != ',') {
+			break;
+		}
+
+		++p;
+	}
+
+	return program;
+}
+
+// Contents of a program file, mapped into memory if possible
+class ProgramImage {
+public:
+	explicit ProgramImage(const char *filename) {
+		map_file(filename);
+
+		if (is_binary()) {
+			std::uint64_t count = get_u64(file_data + 8);
+
+			if (count > (file_size - header_size) / 8) {
+				std::cerr << "truncated image " << filename << std::endl;
+				exit(1);
+			}
+
+			num_words = static_cast<std::size_t>(count);
+
+			if (mapped && little_endian()) {
+				words = reinterpret_cast<const long long *>(file_data + header_size);
+			}
+			else {
+				for (std::size_t i = 0; i < num_words; ++i) {
+					owned.push_back(static_cast<long long>(get_u64(file_data + header_size + 8 * i)));
+				}
+				words = owned.data();
+				unmap_file();
+			}
+		}
+		else {
+			owned = parse_program(file_data, file_data + file_size);
+			words = owned.data();
+			num_words = owned.size();
+			unmap_file();
+		}
+	}
+
+	ProgramImage(const ProgramImage &) = delete;
+	ProgramImage &operator=(const ProgramImage &) = delete;
+
+	~ProgramImage() { unmap_file(); }
+
+	static std::shared_ptr<const ProgramImage> load(const char *filename) {
+		return std::make_shared<const ProgramImage>(filename);
+	}
+
+	const long long *data() const { return words; }
+	std::size_t size() const { return num_words; }
+
+	std::vector<long long> to_vector() const & { return std::vector<long long>(words, words + num_words); }
+
+	std::vector<long long> to_vector() && {
+		if (words == owned.data()) {
+			return std::move(owned);
+		}
+
+		return std::vector<long long>(words, words + num_words);
+	}
+
+private:
+	static constexpr char magic[] = "ICB1\0\0\0\0";
+	static constexpr std::size_t header_size = 16;
+
+	const char *file_data = nullptr;
+	std::size_t file_size = 0;
+	bool mapped = false;
+	std::string buffer;
+	std::vector<long long> owned;
+	const long long *words = nullptr;
+	std::size_t num_words = 0;
+
+	bool is_binary() const {
+		return file_size >= header_size && std::memcmp(file_data, magic, 8) == 0;
+	}
+
+	static bool little_endian() {
+		std::uint16_t one = 1;
+		unsigned char byte;
+		std::memcpy(&byte, &one, 1);
+		return byte == 1;
+	}
+
+	static std::uint64_t get_u64(const char *p) {
+		std::uint64_t value = 0;
+
+		for (int i = 7; i >= 0; --i) {
+			value = (value << 8) | static_cast<unsigned char>(p[i]);
+		}
+
+		return value;
+	}
+
+	void map_file(const char *filename) {
+#if INTCODE_MMAP
+		int fd = open(filename, O_RDONLY);
+
+		if (fd != -1) {
+			struct stat st;
+
+			if (fstat(fd, &st) == 0 && st.st_size > 0) {
+				void *p = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+				if (p != MAP_FAILED) {
+					file_data = static_cast<const char *>(p);
+					file_size = static_cast<std::size_t>(st.st_size);
+					mapped = true;
+				}
+			}
+
+			close(fd);
+
+			if (mapped) {
+				return;
+			}
+		}
+#endif
+
+		std::ifstream infile(filename, std::ios::binary);
+
+		buffer.assign(std::istreambuf_iterator<char>(infile), std::istreambuf_iterator<char>());
+
+		file_data = buffer.data();
+		file_size = buffer.size();
+	}
+
+	void unmap_file() {
+#if INTCODE_MMAP
+		if (mapped) {
+			munmap(const_cast<char *>(file_data), file_size);
+			mapped = false;
+		}
+#endif
+
+		buffer.clear();
+		buffer.shrink_to_fit();
+
+		file_data = nullptr;
+		file_size = 0;
+	}
+};
+
+// Write program as a binary image, returns false on failure
+inline bool write_program_image(const char *filename, const std::vector<long long> &program)
+{
+	std::ofstream outfile(filename, std::ios::binary);
+
+	auto put_u64 = [&](std::uint64_t value) {
+		for (int i = 0; i < 8; ++i) {
+			outfile.put(static_cast<char>(value >> (8 * i)));
+		}
+	};
+
+	outfile.write("ICB1\0\0\0\0", 8);
+
+	put_u64(program.size());
+
+	for (long long word : program) {
+		put_u64(static_cast<std::uint64_t>(word));
+	}
+
+	return static_cast<bool>(outfile);
+}
+
+#endif // AOC_INTCODE_IMAGE_H_INCLUDED
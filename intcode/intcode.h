@@ -0,0 +1,786 @@
+//
+// Intcode computer shared by the Advent of Code 2019 days
+//
+
+// The Computer is parameterized on an IODevice, which must provide
+//
+//   bool operator>>(long long &rhs)  - read next input value
+//   bool operator<<(long long rhs)   - write output value
+//
+// If operator>> returns false, there is no input available, and the
+// computer pauses before the input instruction, so it is retried when
+// run() or step() is next called. If operator<< returns false, the
+// computer pauses after the output instruction. This lets the host
+// interleave its own logic with the program, one output at a time.
+
+// Each instruction is decoded once into a handler specialized for its
+// opcode and parameter modes, so executing it involves no mode checks.
+//
+// Memory is paged, see memory.h, so a write to a far address only
+// allocates the page it is on. Copying a computer, for instance with
+// fork() or snapshot(), shares memory and decoded instructions until
+// either copy writes to them.
+//
+// On GCC and Clang, run() uses threaded dispatch through a table of
+// label addresses, with a label for each handler that runs it inline,
+// which gives the branch predictor one indirect jump per opcode and mode
+// combination to learn. Define INTCODE_THREADED to 0 to use a switch on
+// the handler instead, which works on any compiler.
+//
+// Defining INTCODE_JIT to 1 on x86-64 Linux makes run() translate basic
+// blocks to native code with the compiler in jit.h, using the
+// interpreter for input, output and anything the JIT cannot handle.
+//
+// Defining INTCODE_PROFILE to 1 makes the computer keep a Profile of the
+// instructions it executes, see profile.h, which is added to a profile
+// of the whole process that is reported at exit.
+// Defining INTCODE_TRACE to 1 lets the computer record a trace of its
+// execution, see trace.h. Defining INTCODE_MEMOIZE to 1 makes it skip
+// calls to functions it has seen called with the same arguments, see
+// memo.h. These turn off the JIT, since JIT code does not go through the
+// handlers.
+
+#ifndef AOC_INTCODE_H_INCLUDED
+#define AOC_INTCODE_H_INCLUDED
+
+#ifndef INTCODE_PROFILE
+#  define INTCODE_PROFILE 0
+#endif
+
+#ifndef INTCODE_TRACE
+#  define INTCODE_TRACE 0
+#endif
+
+#ifndef INTCODE_MEMOIZE
+#  define INTCODE_MEMOIZE 0
+#endif
+
+#ifndef INTCODE_JIT
+#  define INTCODE_JIT 0
+#endif
+
+#if INTCODE_PROFILE || INTCODE_TRACE || INTCODE_MEMOIZE
+#  undef INTCODE_JIT
+#  define INTCODE_JIT 0
+#endif
+
+#if INTCODE_JIT && !(defined(__x86_64__) && defined(__linux__))
+#  undef INTCODE_JIT
+#  define INTCODE_JIT 0
+#endif
+
+#ifndef INTCODE_THREADED
+#  if defined(__GNUC__)
+#    define INTCODE_THREADED 1
+#  else
+#    define INTCODE_THREADED 0
+#  endif
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "image.h"
+#include "memory.h"
+
+// Expands X(Op, M1, M2, M3) for each handler in the order of the handler
+// table, to generate the dispatch code in run()
+#define INTCODE_FOR_MODES3(X, Op, M1, M2) X(Op, M1, M2, 0) X(Op, M1, M2, 1) X(Op, M1, M2, 2)
+#define INTCODE_FOR_MODES2(X, Op, M1) \
+	INTCODE_FOR_MODES3(X, Op, M1, 0) INTCODE_FOR_MODES3(X, Op, M1, 1) INTCODE_FOR_MODES3(X, Op, M1, 2)
+#define INTCODE_FOR_MODES(X, Op) \
+	INTCODE_FOR_MODES2(X, Op, 0) INTCODE_FOR_MODES2(X, Op, 1) INTCODE_FOR_MODES2(X, Op, 2)
+#define INTCODE_FOR_HANDLERS(X) \
+	INTCODE_FOR_MODES(X, 0) INTCODE_FOR_MODES(X, 1) INTCODE_FOR_MODES(X, 2) INTCODE_FOR_MODES(X, 3) \
+	INTCODE_FOR_MODES(X, 4) INTCODE_FOR_MODES(X, 5) INTCODE_FOR_MODES(X, 6) INTCODE_FOR_MODES(X, 7) \
+	INTCODE_FOR_MODES(X, 8) INTCODE_FOR_MODES(X, 9) INTCODE_FOR_MODES(X, 10)
+
+#if INTCODE_JIT
+#  include "jit.h"
+#endif
+
+#if INTCODE_PROFILE
+#  include "profile.h"
+#endif
+
+#if INTCODE_TRACE
+#  include "trace.h"
+#endif
+
+#if INTCODE_MEMOIZE
+#  include "memo.h"
+#endif
+
+inline std::vector<long long> read_program(std::istream &is)
+{
+	std::vector<long long> program;
+	long long code;
+
+	for (char sep = ','; sep == ',' && is >> code; is >> sep) {
+		program.push_back(code);
+	}
+
+	return program;
+}
+
+// Read a program from a text file or binary image, see image.h
+inline std::vector<long long> read_program(const char *filename)
+{
+	return ProgramImage(filename).to_vector();
+}
+
+// IODevice that reads input from stdin and writes output to stdout
+struct ConsoleIO {
+	bool operator>>(long long &rhs)
+	{
+		rhs = 0;
+		std::cin >> rhs;
+		return true;
+	}
+
+	bool operator<<(long long rhs)
+	{
+		std::cout << rhs << '\n';
+		return true;
+	}
+};
+
+template<typename IODevice>
+class Computer {
+	struct Instruction;
+
+	using Handler = bool (*)(Computer &, const Instruction &);
+
+	// Decoded form of the instruction at an address, so the opcode and
+	// parameter modes are only split up once. An opcode of 0 marks an
+	// entry that has not been decoded, or was invalidated by a write.
+	// exec is the instruction handler specialized for the parameter
+	// modes, and index is its position in the handler table, which run()
+	// dispatches on.
+	struct Instruction {
+		int opcode = 0;
+		int index = 0;
+		Handler exec = nullptr;
+		long long arg1 = 0;
+		long long arg2 = 0;
+		long long arg3 = 0;
+	};
+
+	Memory memory;
+	std::shared_ptr<std::vector<Instruction>> decoded;
+	long long pc = 0;
+	long long base = 0;
+	bool halt = false;
+
+#if INTCODE_JIT
+	JitCompiler jit{JitProgram::for_program(memory)};
+#endif
+
+#if INTCODE_PROFILE
+	ProfileHandle profiler;
+#endif
+
+#if INTCODE_TRACE
+	TraceHandle tracer;
+#endif
+
+#if INTCODE_MEMOIZE
+	std::shared_ptr<Memoizer> memo = Memoizer::for_program(memory);
+	std::vector<MemoCall> memo_calls;
+
+	// Jump at pc to target is taken, returns true if it was a call that
+	// was skipped
+	bool memo_call(long long target) {
+		long long entry = memo->call_site(pc);
+
+		if (entry != target || memory.read(base) != pc + 3) {
+			return false;
+		}
+
+		auto res = memo->lookup(entry, [&](long long offset) { return memory.read(base + offset); });
+
+		if (res) {
+			for (const auto &[offset, value] : res->reads) {
+				for (MemoCall &call : memo_calls) {
+					call.read(base + offset, value);
+				}
+			}
+
+			for (const auto &[offset, value] : res->writes) {
+				memo_write(base + offset, value, false);
+				store(base + offset, value);
+			}
+
+			pc = memory.read(base);
+
+			return true;
+		}
+
+		if (!memo->impure(entry)) {
+			memo_calls.emplace_back(entry, base, pc + 3);
+		}
+
+		return false;
+	}
+
+	// Store the results of calls that returned
+	void memo_return() {
+		while (!memo_calls.empty() && pc == memo_calls.back().ret && base == memo_calls.back().base) {
+			MemoCall &call = memo_calls.back();
+
+			if (!call.aborted) {
+				memo->insert(call.entry, std::move(call.reads),
+				             Memoizer::Words(call.writes.begin(), call.writes.end()));
+			}
+
+			memo_calls.pop_back();
+		}
+	}
+
+	// Stop recording the calls in progress, marking the functions impure
+	// if the call did something a pure function does not
+	void memo_abort(bool impure) {
+		for (MemoCall &call : memo_calls) {
+			if (!call.aborted && impure) {
+				memo->mark_impure(call.entry);
+			}
+
+			call.aborted = true;
+		}
+	}
+
+	void memo_read(long long address, bool absolute) {
+		if (absolute) {
+			memo_abort(true);
+			return;
+		}
+
+		long long value = memory.read(address);
+
+		for (MemoCall &call : memo_calls) {
+			call.read(address, value);
+		}
+	}
+
+	void memo_write(long long address, long long value, bool absolute) {
+		if (absolute) {
+			memo_abort(true);
+			return;
+		}
+
+		for (MemoCall &call : memo_calls) {
+			call.write(address, value);
+		}
+	}
+#endif
+
+	// Copies of the computer share decoded instructions like they share
+	// memory, so copy them before changing them if they are shared
+	std::vector<Instruction> &unshare_decoded() {
+		if (decoded.use_count() > 1) {
+			decoded = std::make_shared<std::vector<Instruction>>(*decoded);
+		}
+
+		return *decoded;
+	}
+
+	// Instructions are at most four words long, so a write to address
+	// can only change instructions starting at address - 3 to address
+	void invalidate(long long address) {
+		std::size_t first = address > 3 ? static_cast<std::size_t>(address) - 3 : 0;
+		std::size_t last = std::min(static_cast<std::size_t>(address) + 1, decoded->size());
+
+		for (std::size_t i = first; i < last; ++i) {
+			if ((*decoded)[i].opcode != 0) {
+				unshare_decoded()[i].opcode = 0;
+			}
+		}
+	}
+
+	[[gnu::always_inline]] const Instruction &fetch() {
+		if (static_cast<std::size_t>(pc) < decoded->size()) {
+			const Instruction &ins = (*decoded)[pc];
+
+			if (ins.opcode != 0) {
+				return ins;
+			}
+		}
+
+		return decode();
+	}
+
+#if INTCODE_JIT
+	// Number of words used by the instruction with each handler opcode,
+	// so the JIT only marks those as code, and writes to data right after
+	// a short instruction stay in native code
+	static constexpr int lengths[11] = { 1, 4, 4, 2, 2, 3, 3, 4, 4, 2, 1 };
+#endif
+
+	const Instruction &decode() {
+		static constexpr auto handlers = make_handlers(std::make_index_sequence<11 * 27>());
+
+		std::vector<Instruction> &instructions = unshare_decoded();
+
+		if (static_cast<std::size_t>(pc) >= instructions.size()) {
+			instructions.resize(static_cast<std::size_t>(pc) + 1);
+		}
+
+		Instruction &ins = instructions[pc];
+
+		int opcode = static_cast<int>(memory.read(pc));
+
+		int pmode1 = (opcode / 100) % 10;
+		int pmode2 = (opcode / 1000) % 10;
+		int pmode3 = (opcode / 10000) % 10;
+
+		ins.arg1 = memory.read(pc + 1);
+		ins.arg2 = memory.read(pc + 2);
+		ins.arg3 = memory.read(pc + 3);
+		ins.opcode = opcode % 100;
+
+		// Handlers are indexed by the opcode mapped to the range 0-10,
+		// with 0 for invalid opcodes and 10 for halt
+		int op = ins.opcode == 99 ? 10 : ins.opcode <= 9 ? ins.opcode : 0;
+
+		if (opcode < 0 || pmode1 > 2 || pmode2 > 2 || pmode3 > 2) {
+			ins.index = 0;
+		}
+		else {
+			ins.index = op * 27 + pmode1 * 9 + pmode2 * 3 + pmode3;
+		}
+
+		ins.exec = handlers[ins.index];
+
+#if INTCODE_JIT
+		jit.add_code(pc, lengths[op]);
+#endif
+
+		return ins;
+	}
+
+	template<int Mode>
+	[[gnu::always_inline]] long long get_arg(long long address) {
+		if constexpr (Mode == 1) {
+			return address;
+		}
+		else {
+			if constexpr (Mode == 2) {
+				address = base + address;
+			}
+
+#if INTCODE_PROFILE
+			profiler->read(address);
+#endif
+
+#if INTCODE_MEMOIZE
+			if (!memo_calls.empty()) {
+				memo_read(address, Mode == 0);
+			}
+#endif
+
+			return memory.read(address);
+		}
+	}
+
+	template<int Mode>
+	[[gnu::always_inline]] void set_arg(long long address, long long value) {
+		if constexpr (Mode == 2) {
+			address = base + address;
+		}
+
+#if INTCODE_PROFILE
+		profiler->write(address);
+#endif
+
+#if INTCODE_MEMOIZE
+		if (!memo_calls.empty()) {
+			memo_write(address, value, Mode != 2);
+		}
+#endif
+
+		store(address, value);
+	}
+
+	[[gnu::always_inline]] void store(long long address, long long value) {
+		memory.write(address) = value;
+
+		if (static_cast<std::size_t>(address) < decoded->size() + 3) {
+			invalidate(address);
+		}
+
+#if INTCODE_MEMOIZE
+		if (memo->is_code(address)) {
+			memo->code_written(address);
+		}
+#endif
+
+#if INTCODE_JIT
+		jit.invalidate(address);
+#endif
+	}
+
+	// Instruction handler for handler index Op with parameter modes
+	// M1, M2 and M3 fixed at compile time. Returns false if the computer
+	// should pause.
+	template<int Op, int M1, int M2, int M3>
+	bool exec(const Instruction &ins) {
+#if INTCODE_PROFILE
+		profiler->instruction(pc, ins.opcode);
+#endif
+
+#if INTCODE_TRACE
+		// Input instructions are recorded once they get their input, in
+		// case they pause and are executed again
+		if (Op != 3 && tracer) {
+			tracer->instruction(pc, base, memory);
+		}
+#endif
+
+#if INTCODE_MEMOIZE
+		if (!memo_calls.empty()) {
+			memo_return();
+
+			if constexpr (Op == 3 || Op == 4) {
+				memo_abort(true);
+			}
+		}
+#endif
+
+		if constexpr (Op == 1 || Op == 2 || Op == 7 || Op == 8) {
+			long long op1 = get_arg<M1>(ins.arg1);
+			long long op2 = get_arg<M2>(ins.arg2);
+			long long res;
+
+			if constexpr (Op == 1) {
+				res = op1 + op2;
+			}
+			else if constexpr (Op == 2) {
+				res = op1 * op2;
+			}
+			else if constexpr (Op == 7) {
+				res = op1 < op2;
+			}
+			else {
+				res = op1 == op2;
+			}
+
+			set_arg<M3>(ins.arg3, res);
+
+			pc += 4;
+
+			return true;
+		}
+		else if constexpr (Op == 3) {
+			long long value = 0;
+
+			if (!(io >> value)) {
+				return false;
+			}
+
+#if INTCODE_TRACE
+			if (tracer) {
+				tracer->instruction(pc, base, memory);
+				tracer->input(value);
+			}
+#endif
+
+			set_arg<M1>(ins.arg1, value);
+
+			pc += 2;
+
+			return true;
+		}
+		else if constexpr (Op == 4) {
+			long long op1 = get_arg<M1>(ins.arg1);
+
+#if INTCODE_TRACE
+			if (tracer) {
+				tracer->output(op1);
+			}
+#endif
+
+			pc += 2;
+
+			return static_cast<bool>(io << op1);
+		}
+		else if constexpr (Op == 5 || Op == 6) {
+			long long op1 = get_arg<M1>(ins.arg1);
+			long long op2 = get_arg<M2>(ins.arg2);
+
+#if INTCODE_PROFILE
+			profiler->jump(pc, (op1 != 0) == (Op == 5));
+#endif
+
+#if INTCODE_MEMOIZE
+			if ((op1 != 0) == (Op == 5) && memo_call(op2)) {
+				return true;
+			}
+#endif
+
+			if constexpr (Op == 5) {
+				pc = op1 ? op2 : pc + 3;
+			}
+			else {
+				pc = !op1 ? op2 : pc + 3;
+			}
+
+			return true;
+		}
+		else if constexpr (Op == 9) {
+			base += get_arg<M1>(ins.arg1);
+
+			pc += 2;
+
+			return true;
+		}
+		else if constexpr (Op == 10) {
+			halt = true;
+
+#if INTCODE_TRACE
+			if (tracer) {
+				tracer->halt();
+			}
+#endif
+
+			return false;
+		}
+		else {
+			std::cerr << "opcode error: " << ins.opcode << std::endl;
+			exit(1);
+		}
+	}
+
+	template<int Op, int M1, int M2, int M3>
+	static bool call(Computer &c, const Instruction &ins) {
+		return c.exec<Op, M1, M2, M3>(ins);
+	}
+
+	// Table of handlers indexed by Op * 27 + M1 * 9 + M2 * 3 + M3
+	template<std::size_t... I>
+	static constexpr std::array<Handler, sizeof...(I)> make_handlers(std::index_sequence<I...>) {
+		return {{ &Computer::call<I / 27, (I / 9) % 3, (I / 3) % 3, I % 3>... }};
+	}
+
+public:
+	IODevice io;
+
+	explicit Computer(std::vector<long long> program)
+	 : memory(std::move(program)),
+	   decoded(std::make_shared<std::vector<Instruction>>(memory.dense_size())) {}
+
+	template<typename... Args>
+	Computer(std::vector<long long> program, Args &&...args)
+	 : memory(std::move(program)),
+	   decoded(std::make_shared<std::vector<Instruction>>(memory.dense_size())),
+	   io(std::forward<Args>(args)...) {}
+
+	// Run the program in image, using its words as memory until they are
+	// written to
+	template<typename... Args>
+	explicit Computer(const std::shared_ptr<const ProgramImage> &image, Args &&...args)
+	 : memory(image->data(), image->size(), image),
+	   decoded(std::make_shared<std::vector<Instruction>>(memory.dense_size())),
+	   io(std::forward<Args>(args)...) {}
+
+	bool halted() const { return halt; }
+
+	// Access memory, unwritten addresses read as 0
+	long long peek(long long address) const { return memory.read(address); }
+
+	void poke(long long address, long long value) {
+#if INTCODE_TRACE
+		if (tracer) {
+			tracer->poke(address, value);
+		}
+#endif
+
+#if INTCODE_MEMOIZE
+		memo_abort(false);
+#endif
+
+		set_arg<0>(address, value);
+	}
+
+	// Set pc and relative base, for starting from a saved state
+	void set_registers(long long new_pc, long long new_base) {
+		pc = new_pc;
+		base = new_base;
+	}
+
+	// Use the instructions other has decoded, where the words they were
+	// decoded from are the same in this computer, so a computer that has
+	// not run yet can start with the decoding done by one running the
+	// same program
+	void share_decoded(const Computer &other) {
+		std::vector<Instruction> instructions = *other.decoded;
+
+		for (std::size_t i = 0; i < instructions.size(); ++i) {
+			Instruction &ins = instructions[i];
+
+			if (ins.opcode == 0) {
+				continue;
+			}
+
+			long long address = static_cast<long long>(i);
+
+			for (long long j = address; j < address + 4; ++j) {
+				if (memory.read(j) != other.memory.read(j)) {
+					ins.opcode = 0;
+					break;
+				}
+			}
+
+#if INTCODE_JIT
+			if (ins.opcode != 0) {
+				jit.add_code(address, lengths[ins.index / 27]);
+			}
+#endif
+		}
+
+		decoded = std::make_shared<std::vector<Instruction>>(std::move(instructions));
+	}
+
+	// Number of memory pages in use
+	std::size_t resident_pages() const { return memory.resident_pages(); }
+
+#if INTCODE_MEMOIZE
+	const Memoizer &memoizer() const { return *memo; }
+#endif
+
+#if INTCODE_PROFILE
+	const Profile &profile() const { return *profiler; }
+#endif
+
+	// Copy of the computer, including io, that continues from the current
+	// state. Memory is shared copy-on-write, so a copy only costs the
+	// pages it or the original writes to afterwards.
+	Computer fork() const {
+#if INTCODE_TRACE
+		if (tracer) {
+			std::cerr << "trace error: cannot fork a computer that records a trace" << std::endl;
+			exit(1);
+		}
+#endif
+
+		return *this;
+	}
+
+	// Save the current state, which can be returned to with restore()
+	Computer snapshot() const { return *this; }
+	void restore(const Computer &saved) {
+		*this = saved;
+
+#if INTCODE_TRACE
+		if (tracer) {
+			tracer->restored(pc, base, memory);
+		}
+#endif
+	}
+
+	// Execute one instruction, returns false if halted or paused by io
+	bool step();
+
+	// Run until halted or paused by io, returns false if halted
+	bool run();
+};
+
+template<typename IODevice>
+bool Computer<IODevice>::step()
+{
+	if (halt) {
+		return false;
+	}
+
+	const Instruction &ins = fetch();
+
+	return ins.exec(*this, ins);
+}
+
+#if INTCODE_JIT
+
+template<typename IODevice>
+bool Computer<IODevice>::run()
+{
+	for (;;) {
+		if (halt) {
+			return false;
+		}
+
+		if (auto block = jit.lookup(memory, pc)) {
+			if (jit.execute(block, memory, pc, base) == 0) {
+				continue;
+			}
+		}
+
+		if (!step()) {
+			return !halt;
+		}
+	}
+}
+
+#elif INTCODE_THREADED
+
+template<typename IODevice>
+bool Computer<IODevice>::run()
+{
+#define INTCODE_LABEL_ADDRESS(Op, M1, M2, M3) &&op_##Op##_##M1##_##M2##_##M3,
+	static void *const dispatch[] = { INTCODE_FOR_HANDLERS(INTCODE_LABEL_ADDRESS) };
+#undef INTCODE_LABEL_ADDRESS
+
+	const Instruction *ins;
+
+	if (halt) {
+		return false;
+	}
+
+	goto *dispatch[(ins = &fetch())->index];
+
+	// Each label runs its handler inline and ends with its own indirect
+	// jump to the next one
+#define INTCODE_LABEL(Op, M1, M2, M3) \
+op_##Op##_##M1##_##M2##_##M3: \
+	if (!exec<Op, M1, M2, M3>(*ins)) { \
+		return !halt; \
+	} \
+	goto *dispatch[(ins = &fetch())->index];
+
+	INTCODE_FOR_HANDLERS(INTCODE_LABEL)
+#undef INTCODE_LABEL
+}
+
+#else
+
+template<typename IODevice>
+bool Computer<IODevice>::run()
+{
+	if (halt) {
+		return false;
+	}
+
+	for (;;) {
+		const Instruction &ins = fetch();
+
+		switch (ins.index) {
+#define INTCODE_CASE(Op, M1, M2, M3) \
+		case Op * 27 + M1 * 9 + M2 * 3 + M3: \
+			if (!exec<Op, M1, M2, M3>(ins)) { \
+				return !halt; \
+			} \
+			break;
+
+		INTCODE_FOR_HANDLERS(INTCODE_CASE)
+#undef INTCODE_CASE
+		}
+	}
+}
+
+#endif
+
+#endif // AOC_INTCODE_H_INCLUDED
@@ -0,0 +1,647 @@
+//
+// x86-64 JIT tier for the Intcode computer (Linux only)
+//
+
+// Translates basic blocks of Intcode into native code in mmap'd pages.
+// A block runs from an instruction up to and including the next jump,
+// and stops before any input, output or halt, which are left to the
+// interpreter. Blocks end by jumping through a table of entry points
+// indexed by pc, so execution stays in native code until it reaches an
+// address that has not been translated.
+//
+// Translated code is shared by all computers running the same program,
+// see shared.h. JitProgram translates blocks from the program as it was
+// loaded, and each computer has a JitCompiler with its own table of entry
+// points, which only uses a block if the words it was translated from are
+// unchanged in the computer's memory. Copies of a computer start with the
+// blocks of the original.
+//
+// Code is written to a memory file mapped twice, once writable for
+// writing code and once executable for running it, so no page is ever
+// writable and executable at the same time, and adding a block does not
+// need a system call or disturb threads running other blocks. If the file
+// cannot be mapped, nothing is translated.
+//
+// Generated code keeps the pointer to and size of the dense part of
+// memory and the relative base in registers. Any access outside the dense
+// part, and any write to an address that holds an instruction the
+// interpreter or the JIT has decoded, exits the block before the
+// instruction, so the interpreter can execute it. The interpreter calls
+// invalidate() on writes, which drops any block containing the address
+// and keeps the address from being translated again, since self-modifying
+// code tends to keep modifying the same instructions.
+//
+// Registers used by a block: rdi = JitContext, rsi = code map, r8 =
+// memory, r9 = size, r10 = base, r11 = effective address, and rax, rcx
+// and rdx as scratch.
+
+#ifndef AOC_INTCODE_JIT_H_INCLUDED
+#define AOC_INTCODE_JIT_H_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "memory.h"
+#include "shared.h"
+
+// State shared with generated code, offsets are used in the emitted
+// instructions
+struct JitContext {
+	long long *memory = nullptr;  // 0
+	long long size = 0;           // 8
+	long long base = 0;           // 16
+	long long pc = 0;             // 24
+	const char *code_map = nullptr; // 32
+	const void *const *entries = nullptr; // 40
+	long long num_entries = 0;    // 48
+};
+
+// Executable memory for translated code, in chunks of a memory file that
+// are mapped once for writing and once for executing
+class CodeArena {
+public:
+	CodeArena() = default;
+	CodeArena(const CodeArena &) = delete;
+	CodeArena &operator=(const CodeArena &) = delete;
+
+	~CodeArena() {
+		for (const Chunk &chunk : chunks) {
+			munmap(chunk.write, chunk.size);
+			munmap(chunk.exec, chunk.size);
+		}
+	}
+
+	// Copy code into the arena, returns its executable address, or
+	// nullptr if no memory could be mapped
+	const unsigned char *install(const std::vector<unsigned char> &code) {
+		if (chunks.empty() || used + code.size() > chunks.back().size) {
+			if (!add_chunk(std::max(chunk_size, code.size()))) {
+				return nullptr;
+			}
+		}
+
+		Chunk &chunk = chunks.back();
+
+		std::memcpy(chunk.write + used, code.data(), code.size());
+
+		const unsigned char *p = chunk.exec + used;
+
+		// Keep blocks 16 byte aligned
+		used += (code.size() + 15) & ~static_cast<std::size_t>(15);
+
+		return p;
+	}
+
+private:
+	static constexpr std::size_t chunk_size = 64 * 1024;
+
+	struct Chunk {
+		unsigned char *write;
+		unsigned char *exec;
+		std::size_t size;
+	};
+
+	std::vector<Chunk> chunks;
+	std::size_t used = 0;
+
+	bool add_chunk(std::size_t size) {
+		size = (size + 4095) & ~static_cast<std::size_t>(4095);
+
+		int fd = memfd_create("intcode-jit", MFD_CLOEXEC);
+
+		if (fd == -1) {
+			return false;
+		}
+
+		void *write = MAP_FAILED;
+		void *exec = MAP_FAILED;
+
+		if (ftruncate(fd, static_cast<off_t>(size)) == 0) {
+			write = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			exec = mmap(nullptr, size, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+		}
+
+		close(fd);
+
+		if (write == MAP_FAILED || exec == MAP_FAILED) {
+			if (write != MAP_FAILED) {
+				munmap(write, size);
+			}
+
+			if (exec != MAP_FAILED) {
+				munmap(exec, size);
+			}
+
+			return false;
+		}
+
+		chunks.push_back({static_cast<unsigned char *>(write), static_cast<unsigned char *>(exec), size});
+		used = 0;
+
+		return true;
+	}
+};
+
+// Returns 0 if the block ended on a jump or length limit, and 1 if the
+// interpreter must execute the instruction at ctx->pc
+using JitBlock = int (*)(JitContext *);
+
+// Blocks translated from a program as it was loaded, shared by the
+// computers running it
+class JitProgram {
+public:
+	using Block = JitBlock;
+
+	// Limits on addresses and block length, so displacements fit in 32 bits
+	static constexpr long long max_address = 1LL << 28;
+	static constexpr int max_block_length = 64;
+	static constexpr long long max_block_words = 4 * max_block_length;
+
+	// Size of the code loading registers from JitContext at the start of
+	// each block, which is skipped when jumping between blocks
+	static constexpr std::size_t prologue_size = 4 * 7;
+
+	JitProgram(const long long *words, std::size_t count) : program(words, words + count) {
+		code.clear();
+		exit_to(rdx);
+		stub = arena.install(code);
+	}
+
+	static std::shared_ptr<JitProgram> for_program(const Memory &memory) {
+		return shared_for_program<JitProgram>(memory.dense_words(), memory.dense_size());
+	}
+
+	bool matches(const long long *words, std::size_t count) const {
+		return std::equal(words, words + count, program.begin(), program.end());
+	}
+
+	// Entry point for addresses without a block, which returns to the
+	// interpreter, or nullptr if code cannot be mapped
+	const void *exit_stub() const { return stub; }
+
+	long long word(long long address) const {
+		return static_cast<std::size_t>(address) < program.size() ? program[address] : 0;
+	}
+
+	// Get block starting at pc, translating it if needed, and set end to
+	// the address after it. Returns nullptr if the instruction at pc
+	// cannot be translated.
+	Block block_at(long long pc, long long &end) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (!stub || pc < 0 || pc >= max_address) {
+			return nullptr;
+		}
+
+		if (static_cast<std::size_t>(pc) >= state.size()) {
+			state.resize(static_cast<std::size_t>(pc) + 1, 0);
+			blocks.resize(static_cast<std::size_t>(pc) + 1, nullptr);
+			block_end.resize(static_cast<std::size_t>(pc) + 1, 0);
+		}
+
+		if (state[pc] == 0) {
+			blocks[pc] = translate(pc, block_end[pc]);
+			state[pc] = blocks[pc] ? 1 : 2;
+		}
+
+		end = block_end[pc];
+
+		return blocks[pc];
+	}
+
+private:
+	enum Reg { rax = 0, rcx = 1, rdx = 2, rsi = 6, rdi = 7, r8 = 8, r9 = 9, r10 = 10, r11 = 11 };
+
+	enum Cond { cc_b = 2, cc_ae = 3, cc_e = 4, cc_ne = 5, cc_l = 0xC, cc_le = 0xE };
+
+	std::mutex mutex;
+	std::vector<long long> program;
+	CodeArena arena;
+	const void *stub = nullptr;
+	std::vector<Block> blocks;
+	std::vector<long long> block_end;
+	std::vector<char> state;
+	std::vector<unsigned char> code;
+
+	void emit(std::initializer_list<unsigned char> bytes) { code.insert(code.end(), bytes); }
+
+	void emit32(std::int32_t value) {
+		unsigned char bytes[4];
+		std::memcpy(bytes, &value, 4);
+		code.insert(code.end(), bytes, bytes + 4);
+	}
+
+	void emit64(std::int64_t value) {
+		unsigned char bytes[8];
+		std::memcpy(bytes, &value, 8);
+		code.insert(code.end(), bytes, bytes + 8);
+	}
+
+	static unsigned char rex(int reg, int index, int base) {
+		return static_cast<unsigned char>(0x48 | ((reg >> 3) << 2) | ((index >> 3) << 1) | (base >> 3));
+	}
+
+	static unsigned char modrm(int mod, int reg, int rm) {
+		return static_cast<unsigned char>((mod << 6) | ((reg & 7) << 3) | (rm & 7));
+	}
+
+	// mov reg, [base + disp]
+	void load(Reg reg, Reg base, std::int32_t disp) {
+		emit({ rex(reg, 0, base), 0x8B, modrm(2, reg, base) });
+		emit32(disp);
+	}
+
+	// mov [base + disp], reg
+	void store(Reg base, std::int32_t disp, Reg reg) {
+		emit({ rex(reg, 0, base), 0x89, modrm(2, reg, base) });
+		emit32(disp);
+	}
+
+	// mov reg, [r8 + r11 * 8]
+	void load_indexed(Reg reg) {
+		emit({ rex(reg, r11, r8), 0x8B, modrm(0, reg, 4), modrm(3, r11, r8) });
+	}
+
+	// mov [r8 + r11 * 8], reg
+	void store_indexed(Reg reg) {
+		emit({ rex(reg, r11, r8), 0x89, modrm(0, reg, 4), modrm(3, r11, r8) });
+	}
+
+	// mov reg, imm64
+	void load_imm(Reg reg, long long value) {
+		emit({ rex(0, 0, reg), static_cast<unsigned char>(0xB8 + (reg & 7)) });
+		emit64(value);
+	}
+
+	// lea reg, [base + disp]
+	void lea(Reg reg, Reg base, std::int32_t disp) {
+		emit({ rex(reg, 0, base), 0x8D, modrm(2, reg, base) });
+		emit32(disp);
+	}
+
+	// cmp a, b
+	void cmp(Reg a, Reg b) { emit({ rex(b, 0, a), 0x39, modrm(3, b, a) }); }
+
+	// cmp a, imm32
+	void cmp_imm(Reg a, std::int32_t value) {
+		emit({ rex(0, 0, a), 0x81, modrm(3, 7, a) });
+		emit32(value);
+	}
+
+	// Emit short jump on cond, returns offset to patch with patch_jump()
+	std::size_t jump_if(Cond cond) {
+		emit({ static_cast<unsigned char>(0x70 | cond), 0 });
+		return code.size();
+	}
+
+	void patch_jump(std::size_t from) {
+		code[from - 1] = static_cast<unsigned char>(code.size() - from);
+	}
+
+	// Leave block with the given pc and return value
+	void exit_block(long long pc, int reason) {
+		emit({ 0x48, 0xC7, modrm(2, 0, rdi) });
+		emit32(offsetof(JitContext, pc));
+		emit32(static_cast<std::int32_t>(pc));
+		store(rdi, offsetof(JitContext, base), r10);
+		emit({ 0xB8 });
+		emit32(reason);
+		emit({ 0xC3 });
+	}
+
+	// Leave block with pc in reg, returning 0
+	void exit_to(Reg reg) {
+		store(rdi, offsetof(JitContext, pc), reg);
+		store(rdi, offsetof(JitContext, base), r10);
+		// xor eax, eax; ret
+		emit({ 0x31, 0xC0, 0xC3 });
+	}
+
+	// Continue at the block for pc in rdx
+	void jump_to_rdx() {
+		// cmp rdx, [rdi + num_entries]
+		emit({ rex(rdx, 0, rdi), 0x3B, modrm(2, rdx, rdi) });
+		emit32(offsetof(JitContext, num_entries));
+		std::size_t outside = jump_if(cc_ae);
+		load(rcx, rdi, offsetof(JitContext, entries));
+		// jmp [rcx + rdx * 8]
+		emit({ 0xFF, 0x24, 0xD1 });
+		patch_jump(outside);
+		exit_to(rdx);
+	}
+
+	// Leave block to let the interpreter execute pc if cond holds
+	void exit_if(Cond cond, long long pc) {
+		std::size_t skip = jump_if(static_cast<Cond>(cond ^ 1));
+		exit_block(pc, 1);
+		patch_jump(skip);
+	}
+
+	static bool fits(long long value) {
+		return value > -max_address && value < max_address;
+	}
+
+	// Load operand with mode and value arg into reg
+	void load_arg(Reg reg, int mode, long long arg, long long pc) {
+		switch (mode) {
+		case 0:
+			cmp_imm(r9, static_cast<std::int32_t>(arg));
+			exit_if(cc_le, pc);
+			load(reg, r8, static_cast<std::int32_t>(arg * 8));
+			break;
+		case 1:
+			load_imm(reg, arg);
+			break;
+		case 2:
+			lea(r11, r10, static_cast<std::int32_t>(arg));
+			cmp(r11, r9);
+			exit_if(cc_ae, pc);
+			load_indexed(reg);
+			break;
+		}
+	}
+
+	// Store rax to operand with mode and value arg
+	void store_arg(int mode, long long arg, long long pc) {
+		if (mode == 2) {
+			lea(r11, r10, static_cast<std::int32_t>(arg));
+		}
+		else {
+			load_imm(r11, arg);
+		}
+
+		cmp(r11, r9);
+		exit_if(cc_ae, pc);
+
+		// cmp byte [rsi + r11], 0
+		emit({ 0x42, 0x80, 0x3C, 0x1E, 0x00 });
+		exit_if(cc_ne, pc);
+
+		store_indexed(rax);
+	}
+
+	static int length_of(int opcode) {
+		switch (opcode) {
+		case 1: case 2: case 7: case 8: return 4;
+		case 5: case 6: return 3;
+		case 9: return 2;
+		default: return 0;
+		}
+	}
+
+	// Translate block starting at start, setting end to the address after
+	// the last instruction in it
+	Block translate(long long start, long long &end) {
+		code.clear();
+
+		// Load state into registers
+		load(r8, rdi, offsetof(JitContext, memory));
+		load(r9, rdi, offsetof(JitContext, size));
+		load(r10, rdi, offsetof(JitContext, base));
+		load(rsi, rdi, offsetof(JitContext, code_map));
+
+		long long pc = start;
+
+		for (int n = 0; ; ++n) {
+			long long w = word(pc);
+			int opcode = static_cast<int>(w % 100);
+			int pmode1 = static_cast<int>((w / 100) % 10);
+			int pmode2 = static_cast<int>((w / 1000) % 10);
+			int pmode3 = static_cast<int>((w / 10000) % 10);
+			int length = w < 0 || w > 99999 ? 0 : length_of(opcode);
+
+			long long arg1 = word(pc + 1);
+			long long arg2 = word(pc + 2);
+			long long arg3 = word(pc + 3);
+
+			bool ok = length != 0 && n < max_block_length
+			       && pc + length <= max_address
+			       && pmode1 <= 2 && pmode2 <= 2 && pmode3 <= 2
+			       && (pmode1 == 1 || fits(arg1)) && (pmode2 == 1 || fits(arg2))
+			       && (length < 4 || pmode3 == 1 || fits(arg3))
+			       && (pmode1 != 0 || arg1 >= 0) && (pmode2 != 0 || arg2 >= 0)
+			       && (pmode3 != 0 || length < 4 || arg3 >= 0);
+
+			if (!ok) {
+				if (pc == start) {
+					return nullptr;
+				}
+
+				if (n < max_block_length) {
+					exit_block(pc, 1);
+				}
+				else {
+					// mov edx, pc
+					emit({ 0xBA });
+					emit32(static_cast<std::int32_t>(pc));
+					jump_to_rdx();
+				}
+				break;
+			}
+
+			end = pc + length;
+
+			load_arg(rax, pmode1, arg1, pc);
+
+			if (opcode == 9) {
+				// add r10, rax
+				emit({ 0x49, 0x01, 0xC2 });
+
+				pc += 2;
+
+				continue;
+			}
+
+			load_arg(rcx, pmode2, arg2, pc);
+
+			if (opcode == 5 || opcode == 6) {
+				// mov edx, pc + 3; test rax, rax; cmovne/cmove rdx, rcx
+				emit({ 0xBA });
+				emit32(static_cast<std::int32_t>(pc + 3));
+				emit({ 0x48, 0x85, 0xC0 });
+				emit({ 0x48, 0x0F, static_cast<unsigned char>(opcode == 5 ? 0x45 : 0x44), 0xD1 });
+				jump_to_rdx();
+				break;
+			}
+
+			switch (opcode) {
+			case 1:
+				// add rax, rcx
+				emit({ 0x48, 0x01, 0xC8 });
+				break;
+			case 2:
+				// imul rax, rcx
+				emit({ 0x48, 0x0F, 0xAF, 0xC1 });
+				break;
+			case 7:
+			case 8:
+				// cmp rax, rcx; setl/sete al; movzx eax, al
+				cmp(rax, rcx);
+				emit({ 0x0F, static_cast<unsigned char>(opcode == 7 ? 0x9C : 0x94), 0xC0 });
+				emit({ 0x0F, 0xB6, 0xC0 });
+				break;
+			}
+
+			store_arg(pmode3, arg3, pc);
+
+			pc += 4;
+		}
+
+		return reinterpret_cast<Block>(arena.install(code));
+	}
+
+};
+
+// Blocks in use by one computer, with its own table of entry points
+class JitCompiler {
+public:
+	using Block = JitBlock;
+
+	explicit JitCompiler(std::shared_ptr<JitProgram> program) : program(std::move(program)) {}
+
+	// Get block starting at pc. Returns nullptr if the instruction at pc
+	// cannot be translated, or the block differs in memory from the
+	// program it was translated from.
+	Block lookup(const Memory &memory, long long pc) {
+		if (pc < 0 || pc >= JitProgram::max_address) {
+			return nullptr;
+		}
+
+		if (static_cast<std::size_t>(pc) >= state.size()) {
+			state.resize(static_cast<std::size_t>(pc) + 1, 0);
+			blocks.resize(static_cast<std::size_t>(pc) + 1, nullptr);
+			block_end.resize(static_cast<std::size_t>(pc) + 1, 0);
+			entries.resize(static_cast<std::size_t>(pc) + 1, program->exit_stub());
+		}
+
+		if (state[pc] == 0) {
+			long long end = 0;
+			Block block = program->block_at(pc, end);
+
+			state[pc] = 2;
+
+			if (block && unchanged(memory, pc, end)) {
+				blocks[pc] = block;
+				block_end[pc] = end;
+				entries[pc] = reinterpret_cast<const unsigned char *>(block) + JitProgram::prologue_size;
+				state[pc] = 1;
+
+				mark(pc, end);
+			}
+		}
+
+		return blocks[pc];
+	}
+
+	// Mark addresses that generated code may not write to
+	void add_code(long long address, long long length) {
+		if (static_cast<std::size_t>(address + length) > code_map.size()) {
+			code_map.resize(static_cast<std::size_t>(address + length), 0);
+		}
+
+		for (long long i = 0; i < length; ++i) {
+			code_map[address + i] = 1;
+		}
+	}
+
+	// Run block on memory, returns the block's return value
+	int execute(Block block, Memory &memory, long long &pc, long long &base) {
+		if (code_map.size() < memory.dense_size()) {
+			code_map.resize(memory.dense_size(), 0);
+		}
+
+		ctx.memory = memory.dense_data();
+		ctx.size = static_cast<long long>(memory.dense_size());
+		ctx.base = base;
+		ctx.code_map = code_map.data();
+		ctx.entries = entries.data();
+		ctx.num_entries = static_cast<long long>(entries.size());
+
+		int reason = block(&ctx);
+
+		pc = ctx.pc;
+		base = ctx.base;
+
+		return reason;
+	}
+
+	// Drop blocks containing address after a write to it
+	void invalidate(long long address) {
+		if (address < 0 || static_cast<std::size_t>(address) >= covered.size() || !covered[address]) {
+			return;
+		}
+
+		if (static_cast<std::size_t>(address) >= modified.size()) {
+			modified.resize(static_cast<std::size_t>(address) + 1, 0);
+		}
+
+		// Blocks containing an address are dropped on the first write to
+		// it, and never adopted again
+		if (modified[address]) {
+			return;
+		}
+
+		modified[address] = 1;
+
+		long long first = std::max(0LL, address - JitProgram::max_block_words + 1);
+		long long last = std::min(address + 1, static_cast<long long>(state.size()));
+
+		for (long long start = first; start < last; ++start) {
+			if (state[start] == 1 && block_end[start] > address) {
+				state[start] = 2;
+				blocks[start] = nullptr;
+				entries[start] = program->exit_stub();
+			}
+		}
+	}
+
+private:
+	std::shared_ptr<JitProgram> program;
+	JitContext ctx;
+	std::vector<Block> blocks;
+	std::vector<long long> block_end;
+	std::vector<const void *> entries;
+	std::vector<char> state;
+	std::vector<char> covered;
+	std::vector<char> modified;
+	std::vector<char> code_map;
+
+	// Whether the words from start to end are still the ones the block was
+	// translated from
+	bool unchanged(const Memory &memory, long long start, long long end) const {
+		for (long long i = start; i < end; ++i) {
+			if ((static_cast<std::size_t>(i) < modified.size() && modified[i])
+			 || memory.read(i) != program->word(i)) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	void mark(long long start, long long end) {
+		if (static_cast<std::size_t>(end) > covered.size()) {
+			covered.resize(static_cast<std::size_t>(end), 0);
+		}
+
+		for (long long i = start; i < end; ++i) {
+			covered[i] = 1;
+		}
+
+		add_code(start, end - start);
+	}
+};
+
+#endif // AOC_INTCODE_JIT_H_INCLUDED
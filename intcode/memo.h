@@ -0,0 +1,346 @@
+//
+// Memoization of function calls in Intcode programs
+//
+
+// Memoizer finds the functions of a program with the control flow graph
+// in cfg.h, and keeps the ones that do no input or output and only use
+// relative addresses as candidates. Computers running the same program
+// share one Memoizer, see for_program() and shared.h, and copies of a
+// computer share the Memoizer of the original.
+//
+// When a candidate is called, the computer records the words the call
+// reads before writing them, and the words it writes, as offsets from the
+// relative base at the call. A later call with the same values at those
+// offsets is skipped by storing the recorded words and returning. Since
+// the values of everything the call read are compared, a hit has the same
+// effect as running the call, whatever the function does with its frame.
+// A call that turns out to use an absolute address or io, directly or in
+// a function it calls, marks the function as impure.
+//
+// The return address, at offset 0, is not part of the key, so calls from
+// different call sites share results.
+//
+// A write to the code of a candidate, by any computer sharing the
+// Memoizer, drops its results and marks it impure, since calls after the
+// write may compute something else.
+
+#ifndef AOC_INTCODE_MEMO_H_INCLUDED
+#define AOC_INTCODE_MEMO_H_INCLUDED
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "cfg.h"
+#include "memory.h"
+#include "shared.h"
+
+class Memoizer {
+public:
+	using Words = std::vector<std::pair<long long, long long>>;
+
+	// Words read and written by a call, as offset and value
+	struct Result {
+		Words reads;
+		Words writes;
+	};
+
+	Memoizer(const long long *words, std::size_t count) : program(words, words + count) {
+		ControlFlowGraph cfg(program);
+
+		for (const CodeFunction &fn : cfg.functions()) {
+			if (!is_candidate(cfg, fn)) {
+				continue;
+			}
+
+			for (long long caller : fn.callers) {
+				call_sites[caller] = fn.entry;
+			}
+
+			for (int b : fn.blocks) {
+				const CodeBlock &block = cfg.blocks()[b];
+
+				if (static_cast<std::size_t>(block.end) > code_owners.size()) {
+					code_owners.resize(static_cast<std::size_t>(block.end));
+				}
+
+				for (long long address = block.start; address < block.end; ++address) {
+					code_owners[address].push_back(fn.entry);
+				}
+			}
+
+			tables[fn.entry];
+		}
+	}
+
+	// Shared Memoizer for the program in memory, whose statistics are
+	// reported at exit
+	static std::shared_ptr<Memoizer> for_program(const Memory &memory) {
+		std::shared_ptr<Memoizer> memo = shared_for_program<Memoizer>(memory.dense_words(), memory.dense_size());
+
+		Reports &reports = Reports::get();
+
+		std::lock_guard<std::mutex> lock(reports.mutex);
+
+		if (!memo->in_reports) {
+			memo->in_reports = true;
+			reports.memoizers.push_back(memo);
+		}
+
+		return memo;
+	}
+
+	bool matches(const long long *words, std::size_t count) const {
+		return std::equal(words, words + count, program.begin(), program.end());
+	}
+
+	// Entry of the candidate function called by the jump at pc, or -1
+	long long call_site(long long pc) const {
+		if (auto it = call_sites.find(pc); it != call_sites.end()) {
+			return it->second;
+		}
+
+		return -1;
+	}
+
+	// Find a result for a call to entry, read(offset) gives the word at
+	// offset from the relative base at the call
+	template<typename Read>
+	std::optional<Result> lookup(long long entry, Read read) {
+		++num_calls;
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		Table &table = tables[entry];
+
+		for (const Shape &shape : table.shapes) {
+			std::vector<long long> values;
+
+			for (long long offset : shape.offsets) {
+				values.push_back(read(offset));
+			}
+
+			if (auto it = shape.results.find(values); it != shape.results.end()) {
+				++num_hits;
+
+				Result res;
+
+				for (std::size_t i = 0; i < values.size(); ++i) {
+					res.reads.emplace_back(shape.offsets[i], values[i]);
+				}
+
+				res.writes = it->second;
+
+				return res;
+			}
+		}
+
+		return std::nullopt;
+	}
+
+	void insert(long long entry, Words reads, Words writes) {
+		std::sort(reads.begin(), reads.end());
+
+		std::vector<long long> offsets;
+		std::vector<long long> values;
+
+		for (const auto &[offset, value] : reads) {
+			offsets.push_back(offset);
+			values.push_back(value);
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		Table &table = tables[entry];
+
+		// The code was written to while the call ran
+		if (table.impure) {
+			return;
+		}
+
+		auto shape = std::find_if(table.shapes.begin(), table.shapes.end(),
+		                          [&](const Shape &s) { return s.offsets == offsets; });
+
+		if (shape == table.shapes.end()) {
+			if (table.shapes.size() >= max_shapes) {
+				return;
+			}
+
+			shape = table.shapes.insert(table.shapes.end(), Shape{std::move(offsets), {}});
+		}
+
+		if (shape->results.size() < max_results) {
+			shape->results.emplace(std::move(values), std::move(writes));
+			++num_stored;
+		}
+	}
+
+	void mark_impure(long long entry) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (tables[entry].impure) {
+			return;
+		}
+
+		tables[entry].impure = true;
+		tables[entry].shapes.clear();
+
+		++num_impure;
+	}
+
+	bool impure(long long entry) {
+		std::lock_guard<std::mutex> lock(mutex);
+		return tables[entry].impure;
+	}
+
+	// Whether address holds code of a candidate function
+	bool is_code(long long address) const {
+		return static_cast<std::size_t>(address) < code_owners.size() && !code_owners[address].empty();
+	}
+
+	// Drop the results of the candidates with code at address
+	void code_written(long long address) {
+		for (long long entry : code_owners[address]) {
+			mark_impure(entry);
+		}
+	}
+
+	long long calls() const { return num_calls; }
+	long long hits() const { return num_hits; }
+
+	void report(std::ostream &os) const {
+		if (num_calls != 0) {
+			os << "memoized calls: " << num_calls << " calls, " << num_hits << " hits ("
+			   << 100.0 * static_cast<double>(num_hits) / static_cast<double>(num_calls) << "%), "
+			   << num_stored << " results stored, " << num_impure << " functions impure\n";
+		}
+	}
+
+private:
+	// Limits on what is kept per function, so functions that are never
+	// called with the same values do not use up memory
+	static constexpr std::size_t max_shapes = 16;
+	static constexpr std::size_t max_results = std::size_t(1) << 16;
+
+	struct ValuesHash {
+		std::size_t operator()(const std::vector<long long> &values) const noexcept {
+			std::size_t h = values.size();
+
+			for (long long v : values) {
+				h = h * 31 + std::hash<long long>()(v);
+			}
+
+			return h;
+		}
+	};
+
+	// Results for calls that read the same offsets
+	struct Shape {
+		std::vector<long long> offsets;
+		std::unordered_map<std::vector<long long>, Words, ValuesHash> results;
+	};
+
+	struct Table {
+		std::vector<Shape> shapes;
+		bool impure = false;
+	};
+
+	std::vector<long long> program;
+	std::unordered_map<long long, long long> call_sites;
+	std::vector<std::vector<long long>> code_owners;
+	std::unordered_map<long long, Table> tables;
+	std::mutex mutex;
+
+	std::atomic<long long> num_calls{0};
+	std::atomic<long long> num_hits{0};
+	std::atomic<long long> num_stored{0};
+	std::atomic<long long> num_impure{0};
+
+	// Memoizers handed out by for_program(), which are reported by an
+	// atexit hook. They are registered after the shared_for_program()
+	// registry holding them is created, so the hook runs while they are
+	// still alive.
+	struct Reports {
+		std::mutex mutex;
+		std::vector<std::weak_ptr<const Memoizer>> memoizers;
+
+		static Reports &get() {
+			static Reports reports;
+			static const bool registered = std::atexit([] { get().report(); }) == 0;
+			static_cast<void>(registered);
+
+			return reports;
+		}
+
+		void report() {
+			std::lock_guard<std::mutex> lock(mutex);
+
+			for (const auto &memoizer : memoizers) {
+				if (auto memo = memoizer.lock()) {
+					memo->report(std::cerr);
+				}
+			}
+		}
+	};
+
+	bool in_reports = false;
+
+	static bool is_candidate(const ControlFlowGraph &cfg, const CodeFunction &fn) {
+		const auto &code = cfg.instructions();
+
+		for (int b : fn.blocks) {
+			const CodeBlock &block = cfg.blocks()[b];
+
+			for (auto it = code.find(block.start); it != code.end() && it->first < block.end; ++it) {
+				const CodeInstruction &ins = it->second;
+
+				if (!ins.valid || ins.opcode == 3 || ins.opcode == 4 || ins.opcode == 99) {
+					return false;
+				}
+
+				for (int i = 0; i < ins.length - 1; ++i) {
+					if (ins.mode[i] == 0 || (ins.opcode == 9 && ins.mode[i] != 1)) {
+						return false;
+					}
+				}
+			}
+		}
+
+		return true;
+	}
+};
+
+// Recording of a call to a candidate function in progress
+struct MemoCall {
+	long long entry = 0;
+	long long base = 0;
+	long long ret = 0;
+	bool aborted = false;
+	Memoizer::Words reads;
+	std::unordered_set<long long> read_offsets;
+	std::unordered_map<long long, long long> writes;
+
+	MemoCall(long long entry, long long base, long long ret) : entry(entry), base(base), ret(ret) {}
+
+	void read(long long address, long long value) {
+		long long offset = address - base;
+
+		if (offset != 0 && !writes.count(offset) && read_offsets.insert(offset).second) {
+			reads.emplace_back(offset, value);
+		}
+	}
+
+	void write(long long address, long long value) { writes[address - base] = value; }
+};
+
+#endif // AOC_INTCODE_MEMO_H_INCLUDED
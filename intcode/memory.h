@@ -0,0 +1,265 @@
+//
+// Paged memory for the Intcode computer
+//
+
+// Memory starts out as a dense vector holding the program. Writes to the
+// rest of the page the program ends in, or to the page after it, extend the
+// dense part to the end of that page, so a stack growing up from the
+// program stays dense. Other addresses are stored in fixed size pages
+// allocated on the first write, found through a one-level page table, with
+// a hash map for pages too far out for the table. Reading an address that
+// was never written returns 0 without allocating anything.
+//
+// Copying memory is copy-on-write. The copies share the dense part and the
+// pages, and a write copies what it hits if it is still shared, so the
+// dense part is copied once and other pages one at a time. The dense part
+// can also start out as words owned by something else, like a mapped
+// program image, which are copied on the first write the same way.
+//
+// Copying marks the dense part of the original as shared too, with a
+// relaxed atomic store, so several threads can copy the same memory at
+// once, as long as none of them writes to it.
+
+#ifndef AOC_INTCODE_MEMORY_H_INCLUDED
+#define AOC_INTCODE_MEMORY_H_INCLUDED
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class Memory {
+public:
+	static constexpr int page_bits = 10;
+	static constexpr std::size_t page_size = std::size_t(1) << page_bits;
+
+	Memory() : Memory(std::vector<long long>()) {}
+
+	explicit Memory(std::vector<long long> program)
+	 : dense(std::make_shared<std::vector<long long>>(std::move(program))),
+	   data(dense->data()), size(dense->size()) {}
+
+	// Use count words at words as the initial dense part, kept alive by
+	// owner, without copying them until they are written to
+	Memory(const long long *words, std::size_t count, std::shared_ptr<const void> owner)
+	 : data(const_cast<long long *>(words)), size(count), dense_shared(true), owner(std::move(owner)) {}
+
+	Memory(const Memory &other)
+	 : dense(other.dense), data(other.data), size(other.size), dense_shared(true),
+	   owner(other.owner), table(other.table), far(other.far), num_pages(other.num_pages) {
+		other.dense_shared.store(true, std::memory_order_relaxed);
+	}
+
+	Memory &operator=(const Memory &other) {
+		if (this != &other) {
+			Memory copy(other);
+			*this = std::move(copy);
+		}
+		return *this;
+	}
+
+	Memory(Memory &&other) noexcept
+	 : dense(std::move(other.dense)), data(other.data), size(other.size),
+	   dense_shared(other.dense_shared.load(std::memory_order_relaxed)), owner(std::move(other.owner)),
+	   table(std::move(other.table)), far(std::move(other.far)), num_pages(other.num_pages) {}
+
+	Memory &operator=(Memory &&other) noexcept {
+		dense = std::move(other.dense);
+		data = other.data;
+		size = other.size;
+		dense_shared.store(other.dense_shared.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		owner = std::move(other.owner);
+		table = std::move(other.table);
+		far = std::move(other.far);
+		num_pages = other.num_pages;
+		return *this;
+	}
+
+	[[gnu::always_inline]] long long read(long long address) const {
+		if (static_cast<std::size_t>(address) < size) {
+			return data[address];
+		}
+
+		return read_page(address);
+	}
+
+	// Get a reference to address for writing, allocating it if needed
+	[[gnu::always_inline]] long long &write(long long address) {
+		if (static_cast<std::size_t>(address) < size && !dense_shared.load(std::memory_order_relaxed)) {
+			return data[address];
+		}
+
+		return write_slow(address);
+	}
+
+	// The dense part of memory, which starts at address 0
+	long long *dense_data() {
+		unshare_dense();
+		return data;
+	}
+
+	// The dense part for reading, without copying it if it is shared
+	const long long *dense_words() const { return data; }
+
+	std::size_t dense_size() const { return size; }
+
+	// Number of pages in use, including the dense part and pages shared
+	// with copies
+	std::size_t resident_pages() const { return dense_pages() + num_pages; }
+
+	std::size_t resident_bytes() const { return resident_pages() * page_size * sizeof(long long); }
+
+	// Call fn(address, words, count) for the dense part and each page
+	template<typename Fn>
+	void for_each_chunk(Fn fn) const {
+		if (size != 0) {
+			fn(0, data, size);
+		}
+
+		for (std::size_t index = 0; index < table.size(); ++index) {
+			if (table[index]) {
+				fn(static_cast<long long>(index << page_bits), table[index]->data(), page_size);
+			}
+		}
+
+		for (const auto &[index, page] : far) {
+			fn(static_cast<long long>(index << page_bits), page->data(), page_size);
+		}
+	}
+
+private:
+	using Page = std::array<long long, page_size>;
+
+	// Pages with an index below this are in the table
+	static constexpr std::size_t max_table_pages = std::size_t(1) << 20;
+
+	std::shared_ptr<std::vector<long long>> dense;
+	long long *data = nullptr;
+	std::size_t size = 0;
+
+	// Set when the dense part may be shared with a copy, or is owned by
+	// owner
+	mutable std::atomic<bool> dense_shared{false};
+	std::shared_ptr<const void> owner;
+
+	std::vector<std::shared_ptr<Page>> table;
+	std::unordered_map<std::size_t, std::shared_ptr<Page>> far;
+	std::size_t num_pages = 0;
+
+	static std::size_t page_index(long long address) {
+		if (address < 0) {
+			std::cerr << "address error: " << address << std::endl;
+			exit(1);
+		}
+
+		return static_cast<std::size_t>(address) >> page_bits;
+	}
+
+	// Number of pages the dense part touches
+	std::size_t dense_pages() const { return (size + page_size - 1) >> page_bits; }
+
+	static std::size_t page_offset(long long address) {
+		return static_cast<std::size_t>(address) & (page_size - 1);
+	}
+
+	std::shared_ptr<Page> *find(std::size_t index) {
+		if (index < max_table_pages) {
+			return index < table.size() && table[index] ? &table[index] : nullptr;
+		}
+
+		auto it = far.find(index);
+
+		return it != far.end() ? &it->second : nullptr;
+	}
+
+	const std::shared_ptr<Page> *find(std::size_t index) const {
+		return const_cast<Memory *>(this)->find(index);
+	}
+
+	long long read_page(long long address) const {
+		const std::shared_ptr<Page> *page = find(page_index(address));
+
+		return page ? (**page)[page_offset(address)] : 0;
+	}
+
+	long long &write_slow(long long address) {
+		if (static_cast<std::size_t>(address) < size) {
+			unshare_dense();
+			return data[address];
+		}
+
+		std::size_t index = page_index(address);
+
+		if (index <= dense_pages()) {
+			grow_dense(index);
+			return data[address];
+		}
+
+		std::shared_ptr<Page> *page = find(index);
+
+		if (!page) {
+			page = &allocate(index);
+		}
+		else if (page->use_count() > 1) {
+			*page = std::make_shared<Page>(**page);
+		}
+
+		return (**page)[page_offset(address)];
+	}
+
+	std::shared_ptr<Page> &allocate(std::size_t index) {
+		++num_pages;
+
+		if (index < max_table_pages) {
+			if (index >= table.size()) {
+				table.resize(index + 1);
+			}
+			return table[index] = std::make_shared<Page>();
+		}
+
+		return far[index] = std::make_shared<Page>();
+	}
+
+	void unshare_dense() {
+		if (dense_shared.load(std::memory_order_relaxed)) {
+			if (!dense || dense.use_count() > 1) {
+				dense = std::make_shared<std::vector<long long>>(data, data + size);
+				data = dense->data();
+				owner.reset();
+			}
+
+			dense_shared.store(false, std::memory_order_relaxed);
+		}
+	}
+
+	// Extend the dense part to the end of page index, moving in that
+	// page if it was allocated
+	void grow_dense(std::size_t index) {
+		unshare_dense();
+
+		dense->resize((index + 1) << page_bits);
+		data = dense->data();
+		size = dense->size();
+
+		if (std::shared_ptr<Page> *page = find(index)) {
+			std::copy((*page)->begin(), (*page)->end(), data + (index << page_bits));
+
+			if (index < max_table_pages) {
+				table[index].reset();
+			}
+			else {
+				far.erase(index);
+			}
+
+			--num_pages;
+		}
+	}
+};
+
+#endif // AOC_INTCODE_MEMORY_H_INCLUDED
@@ -0,0 +1,300 @@
+//
+// Execution profile for the Intcode computer
+//
+
+// Profile counts instructions per opcode, hits per pc, taken and not
+// taken jumps per pc for opcodes 5 and 6, and operand reads and writes
+// per memory page. Instruction fetches are not counted as reads.
+//
+// The computer only keeps a profile if INTCODE_PROFILE is defined to 1,
+// see intcode.h. The profiles of all computers in the process are added
+// up, and the total is written once at exit, as JSON to the file named by
+// the environment variable INTCODE_PROFILE_OUT, or as CSV if the name ends
+// in .csv, or as JSON to stderr if it is not set. Computers that never
+// halt are included, and a process that runs many computers writes one
+// profile. Adding up profiles assumes the computers run the same program,
+// as they do in each day.
+
+#ifndef AOC_INTCODE_PROFILE_H_INCLUDED
+#define AOC_INTCODE_PROFILE_H_INCLUDED
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "memory.h"
+
+class Profile {
+public:
+	void instruction(long long pc, int opcode) {
+		++num_instructions;
+		++opcodes[static_cast<std::size_t>(opcode) % opcodes.size()];
+
+		PcStats &stats = pcs[pc];
+		stats.opcode = opcode;
+		++stats.hits;
+	}
+
+	void jump(long long pc, bool taken) {
+		PcStats &stats = pcs[pc];
+
+		++(taken ? stats.taken : stats.not_taken);
+	}
+
+	void read(long long address) { ++regions[region(address)].reads; }
+	void write(long long address) { ++regions[region(address)].writes; }
+
+	long long instructions() const { return num_instructions; }
+
+	// Add the counts of other to this profile
+	void merge(const Profile &other);
+
+	void write_json(std::ostream &os) const;
+	void write_csv(std::ostream &os) const;
+
+	// Write the profile where INTCODE_PROFILE_OUT says
+	void report() const {
+		const char *filename = std::getenv("INTCODE_PROFILE_OUT");
+
+		if (filename == nullptr) {
+			write_json(std::cerr);
+			return;
+		}
+
+		std::ofstream outfile(filename);
+
+		if (!outfile) {
+			std::cerr << "unable to open profile file " << filename << std::endl;
+			return;
+		}
+
+		std::string name(filename);
+
+		if (name.size() >= 4 && name.compare(name.size() - 4, 4, ".csv") == 0) {
+			write_csv(outfile);
+		}
+		else {
+			write_json(outfile);
+		}
+	}
+
+private:
+	struct PcStats {
+		int opcode = 0;
+		long long hits = 0;
+		long long taken = 0;
+		long long not_taken = 0;
+	};
+
+	struct RegionStats {
+		long long reads = 0;
+		long long writes = 0;
+	};
+
+	long long num_instructions = 0;
+	std::array<long long, 100> opcodes{};
+	std::unordered_map<long long, PcStats> pcs;
+	std::unordered_map<long long, RegionStats> regions;
+
+	// Negative addresses are an error the computer reports, so they only
+	// need a region to be counted in
+	static long long region(long long address) {
+		return address < 0 ? -1 : address >> Memory::page_bits;
+	}
+
+	template<typename Map>
+	static std::vector<typename Map::const_iterator> sorted(const Map &map) {
+		std::vector<typename Map::const_iterator> res;
+
+		for (auto it = map.begin(); it != map.end(); ++it) {
+			res.push_back(it);
+		}
+
+		std::sort(res.begin(), res.end(), [](auto lhs, auto rhs) { return lhs->first < rhs->first; });
+
+		return res;
+	}
+};
+
+inline void Profile::merge(const Profile &other)
+{
+	num_instructions += other.num_instructions;
+
+	for (std::size_t op = 0; op < opcodes.size(); ++op) {
+		opcodes[op] += other.opcodes[op];
+	}
+
+	for (const auto &[pc, other_stats] : other.pcs) {
+		PcStats &stats = pcs[pc];
+		stats.opcode = other_stats.opcode;
+		stats.hits += other_stats.hits;
+		stats.taken += other_stats.taken;
+		stats.not_taken += other_stats.not_taken;
+	}
+
+	for (const auto &[index, other_stats] : other.regions) {
+		RegionStats &stats = regions[index];
+		stats.reads += other_stats.reads;
+		stats.writes += other_stats.writes;
+	}
+}
+
+inline void Profile::write_json(std::ostream &os) const
+{
+	os << "{\n  \"instructions\": " << num_instructions << ",\n  \"opcodes\": [";
+
+	const char *sep = "\n";
+
+	for (std::size_t op = 0; op < opcodes.size(); ++op) {
+		if (opcodes[op] != 0) {
+			os << sep << "    {\"opcode\": " << op << ", \"count\": " << opcodes[op] << '}';
+			sep = ",\n";
+		}
+	}
+
+	os << "\n  ],\n  \"pcs\": [";
+
+	sep = "\n";
+
+	for (auto it : sorted(pcs)) {
+		const PcStats &stats = it->second;
+
+		os << sep << "    {\"pc\": " << it->first << ", \"opcode\": " << stats.opcode
+		   << ", \"hits\": " << stats.hits;
+
+		if (stats.opcode == 5 || stats.opcode == 6) {
+			os << ", \"taken\": " << stats.taken << ", \"not_taken\": " << stats.not_taken;
+		}
+
+		os << '}';
+		sep = ",\n";
+	}
+
+	os << "\n  ],\n  \"regions\": [";
+
+	sep = "\n";
+
+	for (auto it : sorted(regions)) {
+		long long first = it->first * static_cast<long long>(Memory::page_size);
+
+		os << sep << "    {\"first\": " << first << ", \"last\": " << first + static_cast<long long>(Memory::page_size) - 1
+		   << ", \"reads\": " << it->second.reads << ", \"writes\": " << it->second.writes << '}';
+		sep = ",\n";
+	}
+
+	os << "\n  ]\n}\n";
+}
+
+// One table with a kind column, and empty fields where a column does not
+// apply to the kind
+inline void Profile::write_csv(std::ostream &os) const
+{
+	os << "kind,key,opcode,count,taken,not_taken,reads,writes\n";
+
+	for (std::size_t op = 0; op < opcodes.size(); ++op) {
+		if (opcodes[op] != 0) {
+			os << "opcode," << op << ',' << op << ',' << opcodes[op] << ",,,,\n";
+		}
+	}
+
+	for (auto it : sorted(pcs)) {
+		const PcStats &stats = it->second;
+
+		os << "pc," << it->first << ',' << stats.opcode << ',' << stats.hits << ',';
+
+		if (stats.opcode == 5 || stats.opcode == 6) {
+			os << stats.taken << ',' << stats.not_taken;
+		}
+		else {
+			os << ',';
+		}
+
+		os << ",,\n";
+	}
+
+	for (auto it : sorted(regions)) {
+		os << "region," << it->first * static_cast<long long>(Memory::page_size) << ",,,,,"
+		   << it->second.reads << ',' << it->second.writes << '\n';
+	}
+}
+
+// Profiles of the computers in the process, with the total of those that
+// were destroyed and the ones still live, which is reported at exit
+class ProcessProfile {
+public:
+	static ProcessProfile &get() {
+		static ProcessProfile process;
+		static const bool registered = std::atexit([] { get().report(); }) == 0;
+		static_cast<void>(registered);
+
+		return process;
+	}
+
+	void attach(const Profile *profile) {
+		std::lock_guard<std::mutex> lock(mutex);
+		live.insert(profile);
+	}
+
+	void detach(const Profile *profile) {
+		std::lock_guard<std::mutex> lock(mutex);
+		live.erase(profile);
+		finished.merge(*profile);
+	}
+
+	// Total of all profiles so far
+	Profile total() {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		Profile res = finished;
+
+		for (const Profile *profile : live) {
+			res.merge(*profile);
+		}
+
+		return res;
+	}
+
+	void report() {
+		Profile res = total();
+
+		if (res.instructions() != 0) {
+			res.report();
+		}
+	}
+
+private:
+	std::mutex mutex;
+	std::unordered_set<const Profile *> live;
+	Profile finished;
+};
+
+// Owner of the profile of a computer, which adds it to the process total
+// when the computer is destroyed. Copies of a computer, like forks and
+// snapshots, start with an empty profile, so each instruction is counted
+// once, and assigning to a computer keeps its profile.
+class ProfileHandle {
+public:
+	ProfileHandle() { ProcessProfile::get().attach(&profile); }
+
+	ProfileHandle(const ProfileHandle &) : ProfileHandle() {}
+	ProfileHandle &operator=(const ProfileHandle &) { return *this; }
+
+	~ProfileHandle() { ProcessProfile::get().detach(&profile); }
+
+	Profile *operator->() { return &profile; }
+	const Profile &operator*() const { return profile; }
+
+private:
+	Profile profile;
+};
+
+#endif // AOC_INTCODE_PROFILE_H_INCLUDED
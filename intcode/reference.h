@@ -0,0 +1,173 @@
+//
+// Reference Intcode interpreter
+//
+
+// ReferenceComputer is the Computer as it was before instruction decoding,
+// paged memory and the JIT: a switch on the opcode of each instruction as
+// it is executed, with memory in a vector that grows on access. It has the
+// same interface as Computer, and also counts the instructions it executes,
+// so it serves as the baseline and instruction counter for benchmarks.
+
+#ifndef AOC_INTCODE_REFERENCE_H_INCLUDED
+#define AOC_INTCODE_REFERENCE_H_INCLUDED
+
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+template<typename IODevice>
+class ReferenceComputer {
+	std::vector<long long> memory;
+	long long pc = 0;
+	long long base = 0;
+	bool halt = false;
+	long long num_instructions = 0;
+
+	long long &at(long long address) {
+		if (address < 0) {
+			std::cerr << "address error: " << address << std::endl;
+			exit(1);
+		}
+
+		if (static_cast<std::size_t>(address) >= memory.size()) {
+			memory.resize(static_cast<std::size_t>(address) + 1);
+		}
+
+		return memory[address];
+	}
+
+	long long get_arg(long long address, int mode) {
+		if (mode == 1) {
+			return address;
+		}
+
+		if (mode == 2) {
+			address = base + address;
+		}
+
+		return at(address);
+	}
+
+	void set_arg(long long address, int mode, long long value) {
+		if (mode == 2) {
+			address = base + address;
+		}
+
+		at(address) = value;
+	}
+
+public:
+	IODevice io;
+
+	explicit ReferenceComputer(std::vector<long long> program) : memory(std::move(program)) {}
+
+	template<typename... Args>
+	ReferenceComputer(std::vector<long long> program, Args &&...args)
+	 : memory(std::move(program)), io(std::forward<Args>(args)...) {}
+
+	bool halted() const { return halt; }
+
+	long long peek(long long address) const {
+		return static_cast<std::size_t>(address) < memory.size() ? memory[address] : 0;
+	}
+
+	void poke(long long address, long long value) { at(address) = value; }
+
+	// Number of instructions executed, not counting input instructions
+	// retried after a pause
+	long long instructions() const { return num_instructions; }
+
+	// Execute one instruction, returns false if halted or paused by io
+	bool step();
+
+	// Run until halted or paused by io, returns false if halted
+	bool run() { while (step()) {} return !halt; }
+};
+
+template<typename IODevice>
+bool ReferenceComputer<IODevice>::step()
+{
+	if (halt) {
+		return false;
+	}
+
+	int opcode = static_cast<int>(at(pc));
+
+	int pmode1 = (opcode / 100) % 10;
+	int pmode2 = (opcode / 1000) % 10;
+	int pmode3 = (opcode / 10000) % 10;
+
+	opcode = opcode % 100;
+
+	switch (opcode) {
+	case 1:
+	case 2:
+	case 7:
+	case 8:
+		{
+			long long op1 = get_arg(at(pc + 1), pmode1);
+			long long op2 = get_arg(at(pc + 2), pmode2);
+			long long res = opcode == 1 ? op1 + op2
+			              : opcode == 2 ? op1 * op2
+			              : opcode == 7 ? op1 < op2
+			              : op1 == op2;
+
+			set_arg(at(pc + 3), pmode3, res);
+
+			pc += 4;
+		}
+		break;
+	case 3:
+		{
+			long long value = 0;
+
+			if (!(io >> value)) {
+				return false;
+			}
+
+			set_arg(at(pc + 1), pmode1, value);
+
+			pc += 2;
+		}
+		break;
+	case 4:
+		{
+			long long op1 = get_arg(at(pc + 1), pmode1);
+
+			pc += 2;
+			++num_instructions;
+
+			return static_cast<bool>(io << op1);
+		}
+	case 5:
+	case 6:
+		{
+			long long op1 = get_arg(at(pc + 1), pmode1);
+			long long op2 = get_arg(at(pc + 2), pmode2);
+
+			pc = (op1 != 0) == (opcode == 5) ? op2 : pc + 3;
+		}
+		break;
+	case 9:
+		base += get_arg(at(pc + 1), pmode1);
+
+		pc += 2;
+		break;
+	case 99:
+		halt = true;
+		++num_instructions;
+		return false;
+	default:
+		std::cerr << "opcode error: " << opcode << std::endl;
+		exit(1);
+		break;
+	}
+
+	++num_instructions;
+
+	return true;
+}
+
+#endif // AOC_INTCODE_REFERENCE_H_INCLUDED
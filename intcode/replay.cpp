@@ -0,0 +1,195 @@
+//
+// Replay an Intcode execution trace
+//
+
+// Usage: replay TRACE [CHECKPOINT]
+//
+// Runs the program recorded in TRACE, see trace.h, from the state in
+// checkpoint number CHECKPOINT (default 0, the start), feeding it the
+// recorded input and applying the recorded changes the host made to its
+// state. Outputs are written to stdout, and checked against the recorded
+// ones, with a summary on stderr.
+
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "intcode.h"
+#include "trace.h"
+
+struct Replay {
+	TraceReader &reader;
+	TraceRecord next;
+	bool has_next = false;
+	long long inputs = 0;
+	long long outputs = 0;
+	long long mismatches = 0;
+
+	explicit Replay(TraceReader &reader) : reader(reader) {}
+
+	// Next record that is not a pc or checkpoint, or nullptr at the end
+	const TraceRecord *peek()
+	{
+		while (!has_next) {
+			if (!reader.next(next)) {
+				return nullptr;
+			}
+
+			has_next = next.kind != TraceRecord::Kind::pc
+			        && next.kind != TraceRecord::Kind::checkpoint;
+		}
+
+		return &next;
+	}
+
+	void consume() { has_next = false; }
+
+	// True if the next record changes the state of the computer
+	bool state_change()
+	{
+		const TraceRecord *rec = peek();
+
+		return rec != nullptr && (rec->kind == TraceRecord::Kind::restore
+		                       || rec->kind == TraceRecord::Kind::poke);
+	}
+};
+
+// Feeds recorded input, pausing where the recorded run changed the state
+struct ReplayIO {
+	Replay *replay;
+
+	explicit ReplayIO(Replay *replay) : replay(replay) {}
+
+	bool operator>>(long long &rhs)
+	{
+		const TraceRecord *rec = replay->peek();
+
+		if (rec == nullptr || rec->kind != TraceRecord::Kind::input) {
+			return false;
+		}
+
+		rhs = rec->value;
+
+		replay->consume();
+		++replay->inputs;
+
+		return true;
+	}
+
+	bool operator<<(long long rhs)
+	{
+		std::cout << rhs << '\n';
+
+		const TraceRecord *rec = replay->peek();
+
+		if (rec != nullptr && rec->kind == TraceRecord::Kind::output) {
+			replay->mismatches += rec->value != rhs;
+			replay->consume();
+		}
+		else {
+			++replay->mismatches;
+		}
+
+		++replay->outputs;
+
+		return !replay->state_change();
+	}
+};
+
+Computer<ReplayIO> make_computer(const TraceState &state, Replay &replay)
+{
+	std::vector<long long> dense;
+
+	for (const auto &[address, words] : state.chunks) {
+		if (address == 0) {
+			dense = words;
+		}
+	}
+
+	Computer<ReplayIO> c(dense, &replay);
+
+	for (const auto &[address, words] : state.chunks) {
+		if (address == 0) {
+			continue;
+		}
+
+		for (std::size_t i = 0; i < words.size(); ++i) {
+			if (words[i] != 0) {
+				c.poke(address + static_cast<long long>(i), words[i]);
+			}
+		}
+	}
+
+	c.set_registers(state.pc, state.base);
+
+	return c;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc != 2 && argc != 3) {
+		std::cerr << "usage: replay TRACE [CHECKPOINT]\n";
+		exit(1);
+	}
+
+	TraceReader reader(argv[1]);
+
+	std::vector<std::size_t> checkpoints = reader.checkpoints();
+
+	std::size_t start = argc == 3 ? std::stoul(argv[2]) : 0;
+
+	if (start >= checkpoints.size()) {
+		std::cerr << "no checkpoint " << start << ", trace has " << checkpoints.size() << '\n';
+		exit(1);
+	}
+
+	reader.seek(checkpoints[start]);
+
+	TraceRecord rec;
+
+	reader.next(rec);
+
+	std::cerr << "starting at checkpoint " << start << " of " << checkpoints.size()
+	          << ", instruction " << rec.state.instructions << '\n';
+
+	Replay replay(reader);
+
+	Computer<ReplayIO> c = make_computer(rec.state, replay);
+
+	for (;;) {
+		c.run();
+
+		const TraceRecord *next = replay.peek();
+
+		if (next == nullptr) {
+			break;
+		}
+
+		if (next->kind == TraceRecord::Kind::restore) {
+			c = make_computer(next->state, replay);
+		}
+		else if (next->kind == TraceRecord::Kind::poke) {
+			c.poke(next->address, next->value);
+		}
+		else if (next->kind == TraceRecord::Kind::halt && c.halted()) {
+			replay.consume();
+			continue;
+		}
+		else {
+			break;
+		}
+
+		replay.consume();
+	}
+
+	bool diverged = replay.mismatches != 0 || replay.peek() != nullptr;
+
+	std::cerr << replay.inputs << " inputs, " << replay.outputs << " outputs, "
+	          << replay.mismatches << " mismatches, "
+	          << (diverged ? "diverged from the trace" : "matches the trace") << '\n';
+
+	return diverged ? 1 : 0;
+}
@@ -0,0 +1,57 @@
+//
+// State shared between Intcode computers running the same program
+//
+
+// shared_for_program<T>() returns the T for a program, creating it the
+// first time it is asked for, so computers running the same program share
+// things like translated code and memoized calls instead of each building
+// their own. Programs are found by a hash of their words, and T must be
+// constructible from the words and their count, and have a matches()
+// member that compares them to its own copy.
+//
+// Copies of a computer share the T of the original, so this is only needed
+// when constructing a computer from a program.
+
+#ifndef AOC_INTCODE_SHARED_H_INCLUDED
+#define AOC_INTCODE_SHARED_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+inline std::uint64_t hash_program(const long long *words, std::size_t count)
+{
+	std::uint64_t h = 0xCBF29CE484222325ULL ^ count;
+
+	for (std::size_t i = 0; i < count; ++i) {
+		h = (h ^ static_cast<std::uint64_t>(words[i])) * 0x100000001B3ULL;
+		h ^= h >> 29;
+	}
+
+	return h;
+}
+
+template<typename T>
+std::shared_ptr<T> shared_for_program(const long long *words, std::size_t count)
+{
+	static std::mutex mutex;
+	static std::unordered_multimap<std::uint64_t, std::shared_ptr<T>> shared;
+
+	std::uint64_t h = hash_program(words, count);
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto [first, last] = shared.equal_range(h);
+
+	for (auto it = first; it != last; ++it) {
+		if (it->second->matches(words, count)) {
+			return it->second;
+		}
+	}
+
+	return shared.emplace(h, std::make_shared<T>(words, count))->second;
+}
+
+#endif // AOC_INTCODE_SHARED_H_INCLUDED
@@ -0,0 +1,375 @@
+//
+// Execution trace of the Intcode computer
+//
+
+// A trace is a binary file with a record for each input and output, and
+// optionally each pc, with checkpoints of the full state of the computer
+// at regular intervals. Numbers are stored as LEB128 varints, signed ones
+// zigzag encoded, and a pc is stored as the difference from the previous
+// one, so most instructions take one byte.
+//
+// The computer only records traces if INTCODE_TRACE is defined to 1, see
+// intcode.h. The first computer created then records to the file named by
+// the environment variable INTCODE_TRACE_OUT, if set. INTCODE_TRACE_PCS=1
+// records every pc, and INTCODE_TRACE_CHECKPOINT sets the number of
+// instructions between checkpoints (default 1000000). Changes the host
+// makes to the state, with poke() and restore(), are recorded too, so the
+// trace can be replayed without the host, see replay.cpp.
+//
+// A trace follows one computer, so fork() exits with an error on a
+// computer that records, rather than letting the fork run untraced. The
+// writer is flushed on halt, and at exit, so the trace is complete up to
+// the last record when the computer exits on an error, or the host exits
+// without destroying it.
+
+#ifndef AOC_INTCODE_TRACE_H_INCLUDED
+#define AOC_INTCODE_TRACE_H_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "memory.h"
+
+// Full state of a computer at some point of a trace, with memory as runs
+// of words starting at an address
+struct TraceState {
+	long long instructions = 0;
+	long long pc = 0;
+	long long base = 0;
+	std::vector<std::pair<long long, std::vector<long long>>> chunks;
+};
+
+struct TraceRecord {
+	enum class Kind : char {
+		input = 'I',
+		output = 'O',
+		pc = 'P',
+		checkpoint = 'C',
+		restore = 'R',
+		poke = 'W',
+		halt = 'H'
+	};
+
+	Kind kind = Kind::halt;
+	long long value = 0;
+	long long address = 0;
+	TraceState state;
+};
+
+inline constexpr char trace_magic[] = "ICTR\x01";
+
+class TraceWriter {
+public:
+	TraceWriter(const char *filename, bool record_pcs, long long checkpoint_interval)
+	 : os(filename, std::ios::binary), record_pcs(record_pcs),
+	   checkpoint_interval(checkpoint_interval > 0 ? checkpoint_interval : 1000000) {
+		if (!os) {
+			std::cerr << "unable to open trace file " << filename << std::endl;
+			exit(1);
+		}
+
+		os.write(trace_magic, sizeof(trace_magic) - 1);
+
+		static const bool registered = std::atexit(flush_active) == 0;
+		static_cast<void>(registered);
+
+		active() = this;
+	}
+
+	~TraceWriter() {
+		if (active() == this) {
+			active() = nullptr;
+		}
+	}
+
+	TraceWriter(const TraceWriter &) = delete;
+	TraceWriter &operator=(const TraceWriter &) = delete;
+
+	// Writer for the first computer created, if INTCODE_TRACE_OUT is set
+	static std::unique_ptr<TraceWriter> from_env() {
+		static std::atomic<bool> claimed{false};
+
+		const char *filename = std::getenv("INTCODE_TRACE_OUT");
+
+		if (filename == nullptr || claimed.exchange(true)) {
+			return nullptr;
+		}
+
+		const char *pcs = std::getenv("INTCODE_TRACE_PCS");
+		const char *interval = std::getenv("INTCODE_TRACE_CHECKPOINT");
+
+		return std::make_unique<TraceWriter>(filename, pcs != nullptr && std::string(pcs) == "1",
+		                                     interval != nullptr ? std::atoll(interval) : 0);
+	}
+
+	// Called before each instruction
+	void instruction(long long pc, long long base, const Memory &memory) {
+		if (num_instructions % checkpoint_interval == 0) {
+			write_state(TraceRecord::Kind::checkpoint, pc, base, memory);
+		}
+
+		if (record_pcs) {
+			unsigned long long delta = zigzag(pc - prev_pc);
+
+			if (delta < 0x80) {
+				os.put(static_cast<char>(0x80 | delta));
+			}
+			else {
+				os.put(static_cast<char>(TraceRecord::Kind::pc));
+				put_varint(delta);
+			}
+
+			prev_pc = pc;
+		}
+
+		++num_instructions;
+	}
+
+	void input(long long value) {
+		os.put(static_cast<char>(TraceRecord::Kind::input));
+		put_signed(value);
+	}
+
+	void output(long long value) {
+		os.put(static_cast<char>(TraceRecord::Kind::output));
+		put_signed(value);
+	}
+
+	void poke(long long address, long long value) {
+		os.put(static_cast<char>(TraceRecord::Kind::poke));
+		put_signed(address);
+		put_signed(value);
+	}
+
+	void restored(long long pc, long long base, const Memory &memory) {
+		write_state(TraceRecord::Kind::restore, pc, base, memory);
+	}
+
+	void halt() {
+		os.put(static_cast<char>(TraceRecord::Kind::halt));
+		os.flush();
+	}
+
+private:
+	std::ofstream os;
+	bool record_pcs;
+	long long checkpoint_interval;
+	long long num_instructions = 0;
+	long long prev_pc = 0;
+
+	static TraceWriter *&active() {
+		static TraceWriter *writer = nullptr;
+		return writer;
+	}
+
+	static void flush_active() {
+		if (TraceWriter *writer = active()) {
+			writer->os.flush();
+		}
+	}
+
+	static unsigned long long zigzag(long long value) {
+		return (static_cast<unsigned long long>(value) << 1) ^ static_cast<unsigned long long>(value >> 63);
+	}
+
+	void put_varint(unsigned long long value) {
+		while (value >= 0x80) {
+			os.put(static_cast<char>(value | 0x80));
+			value >>= 7;
+		}
+
+		os.put(static_cast<char>(value));
+	}
+
+	void put_signed(long long value) { put_varint(zigzag(value)); }
+
+	// Later pc records are relative to the pc of the state, so reading
+	// can start at any state
+	void write_state(TraceRecord::Kind kind, long long pc, long long base, const Memory &memory) {
+		std::size_t num_chunks = 0;
+
+		memory.for_each_chunk([&](long long, const long long *, std::size_t) { ++num_chunks; });
+
+		os.put(static_cast<char>(kind));
+		put_varint(static_cast<unsigned long long>(num_instructions));
+		put_signed(pc);
+		put_signed(base);
+		put_varint(num_chunks);
+
+		memory.for_each_chunk([&](long long address, const long long *words, std::size_t count) {
+			put_signed(address);
+			put_varint(count);
+
+			for (std::size_t i = 0; i < count; ++i) {
+				put_signed(words[i]);
+			}
+		});
+
+		prev_pc = pc;
+
+		os.flush();
+	}
+};
+
+// Owner of the trace writer of a computer. Copies of a computer, like
+// snapshots, do not record, and assigning to a computer that records
+// keeps its writer.
+class TraceHandle {
+public:
+	TraceHandle() : writer(TraceWriter::from_env()) {}
+
+	TraceHandle(const TraceHandle &) {}
+	TraceHandle &operator=(const TraceHandle &) { return *this; }
+
+	TraceHandle(TraceHandle &&) noexcept = default;
+	TraceHandle &operator=(TraceHandle &&) noexcept = default;
+
+	explicit operator bool() const { return writer != nullptr; }
+	TraceWriter *operator->() const { return writer.get(); }
+
+private:
+	std::unique_ptr<TraceWriter> writer;
+};
+
+class TraceReader {
+public:
+	explicit TraceReader(const char *filename) {
+		std::ifstream infile(filename, std::ios::binary);
+
+		data.assign(std::istreambuf_iterator<char>(infile), std::istreambuf_iterator<char>());
+
+		std::string magic(trace_magic, sizeof(trace_magic) - 1);
+
+		if (data.size() < magic.size() || std::string(data.begin(), data.begin() + magic.size()) != magic) {
+			std::cerr << "not a trace file " << filename << std::endl;
+			exit(1);
+		}
+
+		pos = magic.size();
+	}
+
+	// Offset of the next record
+	std::size_t tell() const { return pos; }
+	void seek(std::size_t offset) { pos = offset; }
+
+	// Read next record, returns false at the end of the trace
+	bool next(TraceRecord &rec) {
+		if (pos >= data.size()) {
+			return false;
+		}
+
+		unsigned char tag = data[pos++];
+
+		if (tag & 0x80) {
+			rec.kind = TraceRecord::Kind::pc;
+			prev_pc += unzigzag(tag & 0x7F);
+			rec.value = prev_pc;
+			return true;
+		}
+
+		rec.kind = static_cast<TraceRecord::Kind>(tag);
+
+		switch (rec.kind) {
+		case TraceRecord::Kind::input:
+		case TraceRecord::Kind::output:
+			rec.value = get_signed();
+			break;
+		case TraceRecord::Kind::pc:
+			prev_pc += unzigzag(get_varint());
+			rec.value = prev_pc;
+			break;
+		case TraceRecord::Kind::poke:
+			rec.address = get_signed();
+			rec.value = get_signed();
+			break;
+		case TraceRecord::Kind::checkpoint:
+		case TraceRecord::Kind::restore:
+			read_state(rec.state);
+			break;
+		case TraceRecord::Kind::halt:
+			break;
+		default:
+			std::cerr << "trace error at offset " << pos - 1 << std::endl;
+			exit(1);
+		}
+
+		return true;
+	}
+
+	// Offsets of the checkpoint records in the trace
+	std::vector<std::size_t> checkpoints() {
+		std::vector<std::size_t> res;
+		std::size_t saved = pos;
+		long long saved_pc = prev_pc;
+		TraceRecord rec;
+
+		pos = sizeof(trace_magic) - 1;
+
+		for (std::size_t offset = pos; next(rec); offset = pos) {
+			if (rec.kind == TraceRecord::Kind::checkpoint) {
+				res.push_back(offset);
+			}
+		}
+
+		pos = saved;
+		prev_pc = saved_pc;
+
+		return res;
+	}
+
+private:
+	std::vector<unsigned char> data;
+	std::size_t pos = 0;
+	long long prev_pc = 0;
+
+	static long long unzigzag(unsigned long long value) {
+		return static_cast<long long>(value >> 1) ^ -static_cast<long long>(value & 1);
+	}
+
+	unsigned long long get_varint() {
+		unsigned long long value = 0;
+
+		for (int shift = 0; pos < data.size() && shift < 64; shift += 7) {
+			unsigned char byte = data[pos++];
+
+			value |= static_cast<unsigned long long>(byte & 0x7F) << shift;
+
+			if (!(byte & 0x80)) {
+				return value;
+			}
+		}
+
+		std::cerr << "trace error at offset " << pos << std::endl;
+		exit(1);
+	}
+
+	long long get_signed() { return unzigzag(get_varint()); }
+
+	void read_state(TraceState &state) {
+		state.instructions = static_cast<long long>(get_varint());
+		state.pc = get_signed();
+		state.base = get_signed();
+		state.chunks.resize(get_varint());
+
+		for (auto &[address, words] : state.chunks) {
+			address = get_signed();
+			words.resize(get_varint());
+
+			for (long long &word : words) {
+				word = get_signed();
+			}
+		}
+
+		prev_pc = state.pc;
+	}
+};
+
+#endif // AOC_INTCODE_TRACE_H_INCLUDED
@@ -0,0 +1,545 @@
+//
+// Translate an Intcode program to C++ ahead of time
+//
+
+// Usage: transpile PROGRAM [CLASS] > program.h
+//
+// Writes a header with a class template CLASS<IODevice> (default
+// CompiledComputer) with the same interface as Computer<IODevice>, which
+// runs PROGRAM as straight-line C++ that the compiler can optimize. It
+// keeps memory in one vector, so fork() and snapshot() copy all of it.
+//
+// The reachable instructions and basic blocks are found by the control
+// flow graph in cfg.h. Each basic block becomes a label with its operands
+// resolved, and jumps to immediate targets become gotos.
+//
+// The class contains a plain interpreter, which is used for jumps to
+// computed targets that are not the start of a block, and for blocks that
+// have been written to. Once a block is written to it is interpreted from
+// then on, and compiled code resumes at the next block that is intact.
+//
+// Words of translated code that differ in the program the class is
+// constructed with are treated as written, so the program may be patched
+// before running it, like setting address 0 to 2 in days 13 and 17.
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include "cfg.h"
+#include "intcode.h"
+
+using Instruction = CodeInstruction;
+
+class Transpiler {
+public:
+	Transpiler(std::vector<long long> program, std::string name)
+	 : cfg(std::move(program)), code(cfg.instructions()), name(std::move(name)) {}
+
+	void write(std::ostream &os, const std::string &source);
+
+private:
+	ControlFlowGraph cfg;
+	const std::map<long long, Instruction> &code;
+	std::string name;
+	std::vector<long long> block_start;
+	std::vector<int> group;
+	std::vector<int> code_group;
+	std::size_t code_size = 1;
+	std::size_t min_size = 0;
+
+	long long word(long long address) const { return cfg.word(address); }
+
+	void find_blocks();
+
+	int find_group(int g) {
+		while (group[g] != g) {
+			g = group[g] = group[group[g]];
+		}
+
+		return g;
+	}
+
+	// Constant addresses below this are accessed without a size check,
+	// since memory is allocated up to the largest of them
+	static constexpr long long max_direct = 1 << 20;
+
+	static bool is_direct(long long address) {
+		return address >= 0 && address < max_direct;
+	}
+
+	static bool is_destination(const Instruction &ins, int i) {
+		return ins.opcode == 3 ? i == 0 : ins.length == 4 && i == 2;
+	}
+
+	static std::string literal(long long value) {
+		return std::to_string(value) + "LL";
+	}
+
+	std::string label(long long address) const {
+		return "L" + std::to_string(address);
+	}
+
+	bool is_leader(long long address) const { return cfg.is_leader(address); }
+
+	std::string read(const Instruction &ins, int i) const;
+	std::string write_value(const Instruction &ins, int i, const std::string &value) const;
+	std::string jump(long long target) const;
+
+	void write_instruction(std::ostream &os, const Instruction &ins);
+};
+
+void Transpiler::find_blocks()
+{
+	for (const CodeBlock &block : cfg.blocks()) {
+		block_start.push_back(block.start);
+	}
+
+	for (const auto &[address, ins] : code) {
+		code_size = std::max(code_size, static_cast<std::size_t>(ins.next()));
+
+		for (int i = 0; i < ins.length - 1; ++i) {
+			if (!ins.valid || !is_direct(ins.arg[i])) {
+				continue;
+			}
+
+			if (ins.mode[i] == 0 || (ins.mode[i] == 1 && is_destination(ins, i))) {
+				min_size = std::max(min_size, static_cast<std::size_t>(ins.arg[i]) + 1);
+			}
+		}
+	}
+
+	// Instructions that overlap share the flag that marks them written
+	group.resize(block_start.size());
+	std::iota(group.begin(), group.end(), 0);
+
+	std::vector<int> owner(code_size, -1);
+
+	for (const auto &[address, ins] : code) {
+		for (long long a = address; a < address + ins.length; ++a) {
+			if (owner[a] == -1) {
+				owner[a] = ins.block;
+			}
+			else {
+				group[find_group(ins.block)] = find_group(owner[a]);
+			}
+		}
+	}
+
+	min_size = std::max(min_size, code_size);
+
+	code_group.assign(code_size, 0);
+
+	for (const auto &[address, ins] : code) {
+		for (long long a = address; a < address + ins.length; ++a) {
+			code_group[a] = find_group(ins.block) + 1;
+		}
+	}
+}
+
+std::string Transpiler::read(const Instruction &ins, int i) const
+{
+	long long arg = ins.arg[i];
+
+	switch (ins.mode[i]) {
+	case 0:
+		return is_direct(arg) ? "memory[" + literal(arg) + "]" : "at(" + literal(arg) + ")";
+	case 1:
+		return literal(arg);
+	default:
+		return "at(base + " + literal(arg) + ")";
+	}
+}
+
+std::string Transpiler::write_value(const Instruction &ins, int i, const std::string &value) const
+{
+	long long arg = ins.arg[i];
+	long long next = ins.address + ins.length;
+
+	std::string resume = "{ pc = " + literal(next) + "; goto dispatch; }";
+
+	if (ins.mode[i] == 2) {
+		return "if (write(base + " + literal(arg) + ", " + value + ")) " + resume;
+	}
+
+	bool hits_code = static_cast<std::size_t>(arg) < code_size && code_group[arg];
+
+	if (is_direct(arg) && !hits_code) {
+		return "memory[" + literal(arg) + "] = " + value + ";";
+	}
+
+	return "if (write(" + literal(arg) + ", " + value + ")) " + resume;
+}
+
+std::string Transpiler::jump(long long target) const
+{
+	if (is_leader(target) && code.count(target)) {
+		return "goto " + label(target) + ";";
+	}
+
+	return "{ pc = " + literal(target) + "; goto dispatch; }";
+}
+
+void Transpiler::write_instruction(std::ostream &os, const Instruction &ins)
+{
+	long long next = ins.address + ins.length;
+
+	os << "\t// " << ins.address << ":";
+	for (long long a = ins.address; a < next; ++a) {
+		os << ' ' << word(a);
+	}
+	os << '\n';
+
+	if (!ins.valid) {
+		os << "\tpc = " << literal(ins.address) << ";\n"
+		   << "\tgoto interpret;\n";
+		return;
+	}
+
+	switch (ins.opcode) {
+	case 1:
+	case 2:
+	case 7:
+	case 8: {
+		static const char *const ops[] = { "", " + ", " * ", "", "", "", "", " < ", " == " };
+
+		os << "\t{\n"
+		   << "\t\tlong long value = " << read(ins, 0) << ops[ins.opcode] << read(ins, 1) << ";\n"
+		   << "\t\t" << write_value(ins, 2, "value") << '\n'
+		   << "\t}\n";
+		break;
+	}
+	case 3:
+		os << "\t{\n"
+		   << "\t\tlong long value = 0;\n"
+		   << "\t\tif (!(io >> value)) {\n"
+		   << "\t\t\tpc = " << literal(ins.address) << ";\n"
+		   << "\t\t\treturn true;\n"
+		   << "\t\t}\n"
+		   << "\t\t" << write_value(ins, 0, "value") << '\n'
+		   << "\t}\n";
+		break;
+	case 4:
+		os << "\t{\n"
+		   << "\t\tlong long value = " << read(ins, 0) << ";\n"
+		   << "\t\tpc = " << literal(next) << ";\n"
+		   << "\t\tif (!(io << value)) {\n"
+		   << "\t\t\treturn true;\n"
+		   << "\t\t}\n"
+		   << "\t}\n";
+		break;
+	case 5:
+	case 6: {
+		std::string target = ins.mode[1] == 1 ? jump(ins.arg[1])
+		                   : "{ pc = " + read(ins, 1) + "; goto dispatch; }";
+
+		if (ins.mode[0] == 1) {
+			if ((ins.arg[0] != 0) == (ins.opcode == 5)) {
+				os << '\t' << target << '\n';
+			}
+		}
+		else {
+			os << "\tif (" << (ins.opcode == 5 ? "" : "!") << read(ins, 0) << ") "
+			   << target << '\n';
+		}
+		break;
+	}
+	case 9:
+		os << "\tbase += " << read(ins, 0) << ";\n";
+		break;
+	case 99:
+		os << "\thalt = true;\n"
+		   << "\tpc = " << literal(ins.address) << ";\n"
+		   << "\treturn false;\n";
+		break;
+	}
+}
+
+void Transpiler::write(std::ostream &os, const std::string &source)
+{
+	find_blocks();
+
+	std::string guard = "AOC_INTCODE_" + name + "_INCLUDED";
+
+	std::transform(guard.begin(), guard.end(), guard.begin(), [](unsigned char ch) {
+		return std::isalnum(ch) ? std::toupper(ch) : '_';
+	});
+
+	os << "//\n"
+	   << "// " << name << " generated by intcode/transpile.cpp from " << source << '\n'
+	   << "//\n\n"
+	   << "#ifndef " << guard << '\n'
+	   << "#define " << guard << "\n\n"
+	   << "#include <cstddef>\n"
+	   << "#include <cstdlib>\n"
+	   << "#include <iostream>\n"
+	   << "#include <utility>\n"
+	   << "#include <vector>\n\n"
+	   << "template<typename IODevice>\n"
+	   << "class " << name << " {\n"
+	   << "\tstatic constexpr std::size_t code_size = " << code_size << ";\n"
+	   << "\tstatic constexpr std::size_t min_size = " << min_size << ";\n"
+	   << "\tstatic constexpr std::size_t page_size = " << Memory::page_size << ";\n\n"
+	   << "\t// Written flag index + 1 for each word of translated code\n"
+	   << "\tstatic constexpr int code_group[code_size] = {";
+
+	for (std::size_t i = 0; i < code_size; ++i) {
+		os << (i % 16 == 0 ? "\n\t\t" : " ") << code_group[i] << ',';
+	}
+
+	os << "\n\t};\n\n"
+	   << "\t// Program the code was translated from\n"
+	   << "\tstatic constexpr long long code_words[code_size] = {";
+
+	for (std::size_t i = 0; i < code_size; ++i) {
+		os << (i % 8 == 0 ? "\n\t\t" : " ") << literal(word(static_cast<long long>(i))) << ',';
+	}
+
+	os << "\n\t};\n\n"
+	   << "\tstd::vector<long long> memory;\n"
+	   << "\tstd::vector<char> written;\n"
+	   << "\tlong long pc = 0;\n"
+	   << "\tlong long base = 0;\n"
+	   << "\tbool halt = false;\n\n"
+	   << R"(	long long &at(long long address) {
+		if (static_cast<std::size_t>(address) >= memory.size()) {
+			memory.resize(static_cast<std::size_t>(address) + 1);
+		}
+
+		return memory[address];
+	}
+
+	// Store value at address, returns true if it hit translated code
+	bool write(long long address, long long value) {
+		at(address) = value;
+
+		if (static_cast<std::size_t>(address) < code_size && code_group[address]) {
+			written[code_group[address] - 1] = 1;
+			return true;
+		}
+
+		return false;
+	}
+
+	long long get_arg(int mode, long long address) {
+		switch (mode) {
+		case 0: return at(address);
+		case 1: return address;
+		case 2: return at(base + address);
+		default:
+			std::cerr << "mode error: " << mode << std::endl;
+			exit(1);
+		}
+	}
+
+	void set_arg(int mode, long long address, long long value) {
+		write(mode == 2 ? base + address : address, value);
+	}
+
+	void init() {
+		if (memory.size() < min_size) {
+			memory.resize(min_size);
+		}
+
+		for (std::size_t i = 0; i < code_size; ++i) {
+			if (code_group[i] && memory[i] != code_words[i]) {
+				written[code_group[i] - 1] = 1;
+			}
+		}
+	}
+
+public:
+	IODevice io;
+
+)"
+	   << "\texplicit " << name << "(std::vector<long long> program)\n"
+	   << "\t : memory(std::move(program)), written(" << block_start.size() << ") { init(); }\n\n"
+	   << "\ttemplate<typename... Args>\n"
+	   << "\t" << name << "(std::vector<long long> program, Args &&...args)\n"
+	   << "\t : memory(std::move(program)), written(" << block_start.size() << "), io(std::forward<Args>(args)...) { init(); }\n\n"
+	   << R"(	bool halted() const { return halt; }
+
+	// Access memory, unwritten addresses read as 0
+	long long peek(long long address) const {
+		return static_cast<std::size_t>(address) < memory.size() ? memory[address] : 0;
+	}
+
+	void poke(long long address, long long value) { write(address, value); }
+
+	// Set pc and relative base, for starting from a saved state
+	void set_registers(long long new_pc, long long new_base) {
+		pc = new_pc;
+		base = new_base;
+	}
+
+	// Number of memory pages in use, counted in pages the size of those of
+	// Computer, though memory is one vector
+	std::size_t resident_pages() const { return (memory.size() + page_size - 1) / page_size; }
+
+	// Copy of the computer, including io, that continues from the current
+	// state. Unlike Computer, this copies all of memory.
+	)" << name << R"( fork() const { return *this; }
+
+	// Save the current state, which can be returned to with restore()
+	)" << name << R"( snapshot() const { return *this; }
+	void restore(const )" << name << R"( &saved) { *this = saved; }
+
+	// Interpret one instruction, returns false if halted or paused by io
+	bool step();
+
+	// Run until halted or paused by io, returns false if halted
+	bool run();
+};
+
+template<typename IODevice>
+)"
+	   << "bool " << name << R"(<IODevice>::step()
+{
+	if (halt) {
+		return false;
+	}
+
+	int opcode = static_cast<int>(at(pc));
+
+	int pmode1 = (opcode / 100) % 10;
+	int pmode2 = (opcode / 1000) % 10;
+	int pmode3 = (opcode / 10000) % 10;
+
+	switch (opcode % 100) {
+	case 1:
+		set_arg(pmode3, at(pc + 3), get_arg(pmode1, at(pc + 1)) + get_arg(pmode2, at(pc + 2)));
+		pc += 4;
+		return true;
+	case 2:
+		set_arg(pmode3, at(pc + 3), get_arg(pmode1, at(pc + 1)) * get_arg(pmode2, at(pc + 2)));
+		pc += 4;
+		return true;
+	case 3: {
+		long long value = 0;
+
+		if (!(io >> value)) {
+			return false;
+		}
+
+		set_arg(pmode1, at(pc + 1), value);
+		pc += 2;
+		return true;
+	}
+	case 4: {
+		long long value = get_arg(pmode1, at(pc + 1));
+
+		pc += 2;
+
+		return static_cast<bool>(io << value);
+	}
+	case 5:
+		pc = get_arg(pmode1, at(pc + 1)) ? get_arg(pmode2, at(pc + 2)) : pc + 3;
+		return true;
+	case 6:
+		pc = !get_arg(pmode1, at(pc + 1)) ? get_arg(pmode2, at(pc + 2)) : pc + 3;
+		return true;
+	case 7:
+		set_arg(pmode3, at(pc + 3), get_arg(pmode1, at(pc + 1)) < get_arg(pmode2, at(pc + 2)));
+		pc += 4;
+		return true;
+	case 8:
+		set_arg(pmode3, at(pc + 3), get_arg(pmode1, at(pc + 1)) == get_arg(pmode2, at(pc + 2)));
+		pc += 4;
+		return true;
+	case 9:
+		base += get_arg(pmode1, at(pc + 1));
+		pc += 2;
+		return true;
+	case 99:
+		halt = true;
+		return false;
+	default:
+		std::cerr << "opcode error: " << opcode << std::endl;
+		exit(1);
+	}
+}
+
+template<typename IODevice>
+)"
+	   << "bool " << name << R"(<IODevice>::run()
+{
+	if (halt) {
+		return false;
+	}
+
+dispatch:
+	switch (pc) {
+)";
+
+	for (long long address : block_start) {
+		os << "\tcase " << literal(address) << ": goto " << label(address) << ";\n";
+	}
+
+	os << "\tdefault: break;\n"
+	   << "\t}\n\n"
+	   << "interpret:\n"
+	   << "\tif (!step()) {\n"
+	   << "\t\treturn !halt;\n"
+	   << "\t}\n"
+	   << "\tgoto dispatch;\n";
+
+	auto it = code.begin();
+
+	for (std::size_t b = 0; b < block_start.size(); ++b) {
+		os << '\n'
+		   << label(block_start[b]) << ":\n"
+		   << "\tif (written[" << find_group(static_cast<int>(b)) << "]) {\n"
+		   << "\t\tpc = " << literal(block_start[b]) << ";\n"
+		   << "\t\tgoto interpret;\n"
+		   << "\t}\n";
+
+		const Instruction *last = nullptr;
+
+		for (; it != code.end() && it->second.block == static_cast<int>(b); ++it) {
+			write_instruction(os, it->second);
+			last = &it->second;
+		}
+
+		// Continue at the next address unless the block ended with an
+		// unconditional jump, halt or invalid instruction
+		bool falls = last->valid && last->opcode != 99
+		          && !((last->opcode == 5 || last->opcode == 6) && last->mode[0] == 1
+		               && (last->arg[0] != 0) == (last->opcode == 5));
+
+		long long next = last->address + last->length;
+
+		if (falls && (b + 1 == block_start.size() || block_start[b + 1] != next)) {
+			os << '\t' << jump(next) << '\n';
+		}
+	}
+
+	os << "}\n\n"
+	   << "#endif // " << guard << '\n';
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2 || argc > 3) {
+		std::cerr << "usage: transpile PROGRAM [CLASS]\n";
+		exit(1);
+	}
+
+	std::vector<long long> program = read_program(argv[1]);
+
+	if (program.empty()) {
+		std::cerr << "no program in " << argv[1] << '\n';
+		exit(1);
+	}
+
+	Transpiler t(std::move(program), argc == 3 ? argv[2] : "CompiledComputer");
+
+	t.write(std::cout, argv[1]);
+
+	return 0;
+}